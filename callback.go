@@ -21,6 +21,7 @@ package sqlite3
 
 void _sqlite3_result_text(sqlite3_context* ctx, const char* s);
 void _sqlite3_result_blob(sqlite3_context* ctx, const void* b, int l);
+void* _sqlite3_user_data(void* ctx);
 */
 import "C"
 
@@ -30,33 +31,64 @@ import (
 	"math"
 	"reflect"
 	"sync"
+	"sync/atomic"
 	"unsafe"
 )
 
 //export callbackTrampoline
 func callbackTrampoline(ctx *C.sqlite3_context, argc int, argv **C.sqlite3_value) {
 	args := (*[(math.MaxInt32 - 1) / unsafe.Sizeof((*C.sqlite3_value)(nil))]*C.sqlite3_value)(unsafe.Pointer(argv))[:argc:argc]
-	fi := lookupHandle(C.sqlite3_user_data(ctx)).(*functionInfo)
-	fi.Call(ctx, args)
+	switch fn := lookupHandle(C._sqlite3_user_data(unsafe.Pointer(ctx))).(type) {
+	case *rawFunction:
+		fn.f((*SQLiteContext)(ctx), *(*[]*SQLiteValue)(unsafe.Pointer(&args)))
+	case *functionInfo:
+		fn.Call(ctx, args)
+	}
 }
 
 //export stepTrampoline
 func stepTrampoline(ctx *C.sqlite3_context, argc C.int, argv **C.sqlite3_value) {
 	args := (*[(math.MaxInt32 - 1) / unsafe.Sizeof((*C.sqlite3_value)(nil))]*C.sqlite3_value)(unsafe.Pointer(argv))[:int(argc):int(argc)]
-	ai := lookupHandle(C.sqlite3_user_data(ctx)).(*aggInfo)
+	ai := lookupHandle(C._sqlite3_user_data(unsafe.Pointer(ctx))).(*aggInfo)
 	ai.Step(ctx, args)
 }
 
 //export doneTrampoline
 func doneTrampoline(ctx *C.sqlite3_context) {
-	ai := lookupHandle(C.sqlite3_user_data(ctx)).(*aggInfo)
+	ai := lookupHandle(C._sqlite3_user_data(unsafe.Pointer(ctx))).(*aggInfo)
 	ai.Done(ctx)
 }
 
+//export valueTrampoline
+func valueTrampoline(ctx *C.sqlite3_context) {
+	ai := lookupHandle(C._sqlite3_user_data(unsafe.Pointer(ctx))).(*aggInfo)
+	ai.Value(ctx)
+}
+
+//export inverseTrampoline
+func inverseTrampoline(ctx *C.sqlite3_context, argc C.int, argv **C.sqlite3_value) {
+	args := (*[(math.MaxInt32 - 1) / unsafe.Sizeof((*C.sqlite3_value)(nil))]*C.sqlite3_value)(unsafe.Pointer(argv))[:int(argc):int(argc)]
+	ai := lookupHandle(C._sqlite3_user_data(unsafe.Pointer(ctx))).(*aggInfo)
+	ai.Inverse(ctx, args)
+}
+
 //export compareTrampoline
 func compareTrampoline(handlePtr unsafe.Pointer, la C.int, a *C.char, lb C.int, b *C.char) C.int {
-	cmp := lookupHandle(handlePtr).(func(string, string) int)
-	return C.int(cmp(C.GoStringN(a, la), C.GoStringN(b, lb)))
+	switch cmp := lookupHandle(handlePtr).(type) {
+	case func([]byte, []byte) int:
+		return C.int(cmp(bytesView(a, la), bytesView(b, lb)))
+	case func(string, string) int:
+		return C.int(cmp(C.GoStringN(a, la), C.GoStringN(b, lb)))
+	}
+	return 0
+}
+
+// bytesView returns the n bytes at p without copying them.
+func bytesView(p *C.char, n C.int) []byte {
+	if n == 0 {
+		return nil
+	}
+	return (*[math.MaxInt32]byte)(unsafe.Pointer(p))[:n:n]
 }
 
 //export commitHookTrampoline
@@ -77,6 +109,14 @@ func updateHookTrampoline(handle unsafe.Pointer, op int, db *C.char, table *C.ch
 	callback(op, C.GoString(db), C.GoString(table), rowid)
 }
 
+//export walHookTrampoline
+func walHookTrampoline(handle unsafe.Pointer, db *C.sqlite3, name *C.char, pages C.int) C.int {
+	if isMainDB(name) && lookupHandle(handle).(*checkpointer).committed(int(pages)) {
+		C.sqlite3_wal_checkpoint(db, name)
+	}
+	return C.SQLITE_OK
+}
+
 //export authorizerTrampoline
 func authorizerTrampoline(handle unsafe.Pointer, op int, arg1 *C.char, arg2 *C.char, arg3 *C.char) int {
 	callback := lookupHandle(handle).(func(int, string, string, string) int)
@@ -104,40 +144,95 @@ type handleVal struct {
 	val interface{}
 }
 
+// A handle is a C allocation holding the index of its slot in handleTable.
+// Slots are allocated under handleLock but read without any lock, so that
+// callbacks running on different connections do not contend: the chunks
+// are published through an atomic.Value and every slot is an atomic
+// pointer to its immutable handleVal. Each connection keeps track of its
+// own handles, so that closing it does not scan the table.
+const handleChunkSize = 1024
+
+type handleChunk [handleChunkSize]unsafe.Pointer // *handleVal
+
 var handleLock sync.Mutex
-var handleVals = make(map[unsafe.Pointer]handleVal)
+var handleTable atomic.Value // []*handleChunk
+var handleFree []uintptr     // released slot indexes, guarded by handleLock
+var handleNext uintptr       // first never used slot index, guarded by handleLock
 
 func newHandle(db *SQLiteConn, v interface{}) unsafe.Pointer {
 	handleLock.Lock()
 	defer handleLock.Unlock()
-	val := handleVal{db: db, val: v}
-	var p unsafe.Pointer = C.malloc(C.size_t(1))
+	var p unsafe.Pointer = C.malloc(C.size_t(unsafe.Sizeof(uintptr(0))))
 	if p == nil {
 		panic("can't allocate 'cgo-pointer hack index pointer': ptr == nil")
 	}
-	handleVals[p] = val
+	var idx uintptr
+	if n := len(handleFree); n > 0 {
+		idx = handleFree[n-1]
+		handleFree = handleFree[:n-1]
+	} else {
+		idx = handleNext
+		handleNext++
+	}
+	chunks, _ := handleTable.Load().([]*handleChunk)
+	if int(idx/handleChunkSize) == len(chunks) {
+		grown := make([]*handleChunk, len(chunks)+1)
+		copy(grown, chunks)
+		grown[len(chunks)] = new(handleChunk)
+		handleTable.Store(grown)
+		chunks = grown
+	}
+	*(*uintptr)(p) = idx
+	atomic.StorePointer(&chunks[idx/handleChunkSize][idx%handleChunkSize], unsafe.Pointer(&handleVal{db: db, val: v}))
+	if db != nil {
+		if db.handles == nil {
+			db.handles = make(map[unsafe.Pointer]struct{})
+		}
+		db.handles[p] = struct{}{}
+	}
 	return p
 }
 
 func lookupHandleVal(handle unsafe.Pointer) handleVal {
-	handleLock.Lock()
-	defer handleLock.Unlock()
-	return handleVals[handle]
+	idx := *(*uintptr)(handle)
+	chunks := handleTable.Load().([]*handleChunk)
+	if hv := (*handleVal)(atomic.LoadPointer(&chunks[idx/handleChunkSize][idx%handleChunkSize])); hv != nil {
+		return *hv
+	}
+	return handleVal{}
 }
 
 func lookupHandle(handle unsafe.Pointer) interface{} {
 	return lookupHandleVal(handle).val
 }
 
+// freeHandle releases handle. handleLock must be held.
+func freeHandle(handle unsafe.Pointer) {
+	idx := *(*uintptr)(handle)
+	chunks := handleTable.Load().([]*handleChunk)
+	atomic.StorePointer(&chunks[idx/handleChunkSize][idx%handleChunkSize], nil)
+	handleFree = append(handleFree, idx)
+	C.free(handle)
+}
+
+// deleteHandle releases a handle of db that SQLite no longer references,
+// such as the one of a hook that has been replaced.
+func deleteHandle(db *SQLiteConn, handle unsafe.Pointer) {
+	handleLock.Lock()
+	defer handleLock.Unlock()
+	if _, ok := db.handles[handle]; ok {
+		delete(db.handles, handle)
+		freeHandle(handle)
+	}
+}
+
 func deleteHandles(db *SQLiteConn) {
 	handleLock.Lock()
 	defer handleLock.Unlock()
-	for handle, val := range handleVals {
-		if val.db == db {
-			delete(handleVals, handle)
-			C.free(handle)
-		}
+	for handle := range db.handles {
+		freeHandle(handle)
 	}
+	db.handles = nil
 }
 
 // This is only here so that tests can refer to it.
@@ -68,6 +68,16 @@ _sqlite3_bind_blob(sqlite3_stmt *stmt, int n, void *p, int np) {
   return sqlite3_bind_blob(stmt, n, p, np, SQLITE_TRANSIENT);
 }
 
+static int
+_sqlite3_bind_text_static(sqlite3_stmt *stmt, int n, char *p, int np) {
+  return sqlite3_bind_text(stmt, n, p, np, SQLITE_STATIC);
+}
+
+static int
+_sqlite3_bind_blob_static(sqlite3_stmt *stmt, int n, void *p, int np) {
+  return sqlite3_bind_blob(stmt, n, p, np, SQLITE_STATIC);
+}
+
 #include <stdio.h>
 #include <stdint.h>
 
@@ -127,6 +137,20 @@ _sqlite3_prepare_v2_internal(sqlite3 *db, const char *zSql, int nBytes, sqlite3_
 }
 #endif
 
+#ifndef SQLITE_PREPARE_PERSISTENT
+# define SQLITE_PREPARE_PERSISTENT 0x01
+#endif
+
+static int
+_sqlite3_prepare_persistent(sqlite3 *db, const char *zSql, int nBytes, sqlite3_stmt **ppStmt, const char **pzTail)
+{
+#if defined(SQLITE_ENABLE_UNLOCK_NOTIFY) || SQLITE_VERSION_NUMBER < 3020000
+  return _sqlite3_prepare_v2_internal(db, zSql, nBytes, ppStmt, pzTail);
+#else
+  return sqlite3_prepare_v3(db, zSql, nBytes, SQLITE_PREPARE_PERSISTENT, ppStmt, pzTail);
+#endif
+}
+
 void _sqlite3_result_text(sqlite3_context* ctx, const char* s) {
   sqlite3_result_text(ctx, s, -1, &free);
 }
@@ -135,6 +159,16 @@ void _sqlite3_result_blob(sqlite3_context* ctx, const void* b, int l) {
   sqlite3_result_blob(ctx, b, l, SQLITE_TRANSIENT);
 }
 
+// Called for every row with the sqlite3_context as void*, which cgo passes
+// without allocating, unlike a pointer to an incomplete C type.
+void* _sqlite3_user_data(void* ctx) {
+  return sqlite3_user_data(ctx);
+}
+
+void* _sqlite3_aggregate_context(void* ctx, int n) {
+  return sqlite3_aggregate_context(ctx, n);
+}
+
 
 int _sqlite3_create_function(
   sqlite3 *db,
@@ -149,9 +183,25 @@ int _sqlite3_create_function(
   return sqlite3_create_function(db, zFunctionName, nArg, eTextRep, (void*) pApp, xFunc, xStep, xFinal);
 }
 
+int _sqlite3_create_window_function(
+  sqlite3 *db,
+  const char *zFunctionName,
+  int nArg,
+  int eTextRep,
+  uintptr_t pApp,
+  void (*xStep)(sqlite3_context*,int,sqlite3_value**),
+  void (*xFinal)(sqlite3_context*),
+  void (*xValue)(sqlite3_context*),
+  void (*xInverse)(sqlite3_context*,int,sqlite3_value**)
+) {
+  return sqlite3_create_window_function(db, zFunctionName, nArg, eTextRep, (void*) pApp, xStep, xFinal, xValue, xInverse, 0);
+}
+
 void callbackTrampoline(sqlite3_context*, int, sqlite3_value**);
 void stepTrampoline(sqlite3_context*, int, sqlite3_value**);
 void doneTrampoline(sqlite3_context*);
+void valueTrampoline(sqlite3_context*);
+void inverseTrampoline(sqlite3_context*, int, sqlite3_value**);
 
 int compareTrampoline(void*, int, char*, int, char*);
 int commitHookTrampoline(void*);
@@ -206,6 +256,7 @@ import (
 	"strconv"
 	"strings"
 	"sync"
+	"sync/atomic"
 	"syscall"
 	"time"
 	"unsafe"
@@ -347,21 +398,36 @@ const (
 type SQLiteDriver struct {
 	Extensions  []string
 	ConnectHook func(*SQLiteConn) error
+
+	mu     sync.Mutex
+	conns  map[*C.sqlite3]struct{} // open connections, for Stats
+	closed ConnStats               // cumulative counters of closed connections
 }
 
 // SQLiteConn implements driver.Conn.
 type SQLiteConn struct {
-	mu          sync.Mutex
-	db          *C.sqlite3
-	loc         *time.Location
-	txlock      string
-	funcs       []*functionInfo
-	aggregators []*aggInfo
+	mu           sync.Mutex
+	db           *C.sqlite3
+	loc          *time.Location
+	txlock       string
+	queryOnly    bool
+	funcs        []*functionInfo
+	aggregators  []*aggInfo
+	stmtCache    *stmtCache
+	checkpointer *checkpointer
+	prefetchRows int
+	timeFormat   timeFormat
+	watcher      *ctxWatcher
+	driver       *SQLiteDriver               // set when the connection is counted in the driver Stats
+	handles      map[unsafe.Pointer]struct{} // callback handles, guarded by handleLock
+	authorizer   unsafe.Pointer              // handle of the authorizer
+	changeFeed   unsafe.Pointer              // *ChangeFeed, loaded atomically by publishChanges
 }
 
 // SQLiteTx implements driver.Tx.
 type SQLiteTx struct {
-	c *SQLiteConn
+	c         *SQLiteConn
+	queryOnly bool // query_only was turned on for this transaction
 }
 
 // SQLiteStmt implements driver.Stmt.
@@ -372,6 +438,12 @@ type SQLiteStmt struct {
 	t      string
 	closed bool
 	cls    bool
+	cache  *stmtCache // set when the statement is owned by the connection's statement cache
+	key    string     // query text the statement was cached under
+	idle   bool       // true while the statement sits unused in the cache
+	pins   bindPins
+	named  map[string][3]int // memoized parameter indexes of named arguments
+	batch  stmtBatch
 }
 
 // SQLiteResult implements sql.Result.
@@ -386,9 +458,18 @@ type SQLiteRows struct {
 	nc       int
 	cols     []string
 	decltype []string
+	decoders []columnDecoder
 	cls      bool
 	closed   bool
 	ctx      context.Context // no better alternative to pass context into Next() method
+	done     <-chan struct{}
+	watch    cancelWatch
+	batch    rowBatch
+}
+
+// rawFunction is a function registered with RegisterFuncRaw.
+type rawFunction struct {
+	f func(*SQLiteContext, []*SQLiteValue)
 }
 
 type functionInfo struct {
@@ -421,54 +502,161 @@ func (fi *functionInfo) Call(ctx *C.sqlite3_context, argv []*C.sqlite3_value) {
 
 type aggInfo struct {
 	constructor reflect.Value
+	raw         func() RawAggregator
 
 	// Active aggregator objects for aggregations in flight. The
-	// aggregators are indexed by a counter stored in the aggregation
-	// user data space provided by sqlite.
-	active map[int64]reflect.Value
-	next   int64
+	// aggregators are indexed by a slot number, plus one, stored in the
+	// aggregation user data space provided by sqlite. Slots of finished
+	// aggregations are reused.
+	active []RawAggregator
+	free   []int64
 
 	stepArgConverters     []callbackArgConverter
 	stepVariadicConverter callbackArgConverter
 
+	// Indexes of the Step and Done methods of the aggregator type, and of
+	// the Value and Inverse methods of window functions.
+	stepMethod    int
+	doneMethod    int
+	valueMethod   int
+	inverseMethod int
+
 	doneRetConverter callbackRetConverter
+
+	// window is set for window functions, whose states implement
+	// RawWindowAggregator.
+	window bool
 }
 
-func (ai *aggInfo) agg(ctx *C.sqlite3_context) (int64, reflect.Value, error) {
-	aggIdx := (*int64)(C.sqlite3_aggregate_context(ctx, C.int(8)))
-	if *aggIdx == 0 {
-		*aggIdx = ai.next
-		ret := ai.constructor.Call(nil)
-		if len(ret) == 2 && ret[1].Interface() != nil {
-			return 0, reflect.Value{}, ret[1].Interface().(error)
-		}
-		if ret[0].IsNil() {
-			return 0, reflect.Value{}, errors.New("aggregator constructor returned nil state")
-		}
-		ai.next++
-		ai.active[*aggIdx] = ret[0]
-	}
-	return *aggIdx, ai.active[*aggIdx], nil
+// RawAggregator is the state of an aggregation registered with
+// RegisterAggregatorRaw. Step is called for every row and Done once at the
+// end, with the same SQLiteContext and SQLiteValue rules as RegisterFuncRaw.
+type RawAggregator interface {
+	Step(ctx *SQLiteContext, args []*SQLiteValue)
+	Done(ctx *SQLiteContext)
 }
 
-func (ai *aggInfo) Step(ctx *C.sqlite3_context, argv []*C.sqlite3_value) {
-	_, agg, err := ai.agg(ctx)
+// RawWindowAggregator is the state of a window function registered with
+// RegisterWindowAggregatorRaw. Value sets the current result of the
+// aggregation, which goes on, and Inverse removes the oldest rows passed
+// to Step from the window.
+type RawWindowAggregator interface {
+	RawAggregator
+	Value(ctx *SQLiteContext)
+	Inverse(ctx *SQLiteContext, args []*SQLiteValue)
+}
+
+// reflectAggregator is the state of an aggregation registered with
+// RegisterAggregator, with its methods resolved once.
+type reflectAggregator struct {
+	ai      *aggInfo
+	step    reflect.Value
+	done    reflect.Value
+	value   reflect.Value
+	inverse reflect.Value
+}
+
+func (ra *reflectAggregator) Step(ctx *SQLiteContext, values []*SQLiteValue) {
+	ra.call(ra.step, ctx, values)
+}
+
+func (ra *reflectAggregator) Inverse(ctx *SQLiteContext, values []*SQLiteValue) {
+	ra.call(ra.inverse, ctx, values)
+}
+
+func (ra *reflectAggregator) call(fn reflect.Value, ctx *SQLiteContext, values []*SQLiteValue) {
+	argv := *(*[]*C.sqlite3_value)(unsafe.Pointer(&values))
+	args, err := callbackConvertArgs(argv, ra.ai.stepArgConverters, ra.ai.stepVariadicConverter)
 	if err != nil {
-		callbackError(ctx, err)
+		ctx.ResultError(err)
 		return
 	}
 
-	args, err := callbackConvertArgs(argv, ai.stepArgConverters, ai.stepVariadicConverter)
+	ret := fn.Call(args)
+	if len(ret) == 1 && ret[0].Interface() != nil {
+		ctx.ResultError(ret[0].Interface().(error))
+		return
+	}
+}
+
+func (ra *reflectAggregator) Done(ctx *SQLiteContext) {
+	ra.result(ra.done, ctx)
+}
+
+func (ra *reflectAggregator) Value(ctx *SQLiteContext) {
+	ra.result(ra.value, ctx)
+}
+
+func (ra *reflectAggregator) result(fn reflect.Value, ctx *SQLiteContext) {
+	ret := fn.Call(nil)
+	if len(ret) == 2 && ret[1].Interface() != nil {
+		ctx.ResultError(ret[1].Interface().(error))
+		return
+	}
+
+	err := ra.ai.doneRetConverter((*C.sqlite3_context)(ctx), ret[0])
 	if err != nil {
-		callbackError(ctx, err)
+		ctx.ResultError(err)
 		return
 	}
+}
 
-	ret := agg.MethodByName("Step").Call(args)
-	if len(ret) == 1 && ret[0].Interface() != nil {
-		callbackError(ctx, ret[0].Interface().(error))
+func (ai *aggInfo) newAggregator() (RawAggregator, error) {
+	if ai.raw != nil {
+		agg := ai.raw()
+		if agg == nil {
+			return nil, errors.New("aggregator constructor returned nil state")
+		}
+		return agg, nil
+	}
+	ret := ai.constructor.Call(nil)
+	if len(ret) == 2 && ret[1].Interface() != nil {
+		return nil, ret[1].Interface().(error)
+	}
+	if ret[0].IsNil() {
+		return nil, errors.New("aggregator constructor returned nil state")
+	}
+	ra := &reflectAggregator{
+		ai:   ai,
+		step: ret[0].Method(ai.stepMethod),
+		done: ret[0].Method(ai.doneMethod),
+	}
+	if ai.window {
+		ra.value = ret[0].Method(ai.valueMethod)
+		ra.inverse = ret[0].Method(ai.inverseMethod)
+	}
+	return ra, nil
+}
+
+func (ai *aggInfo) agg(ctx *C.sqlite3_context) (*int64, RawAggregator, error) {
+	aggIdx := (*int64)(C._sqlite3_aggregate_context(unsafe.Pointer(ctx), C.int(8)))
+	if aggIdx == nil {
+		return nil, nil, ErrNomem
+	}
+	if *aggIdx == 0 {
+		agg, err := ai.newAggregator()
+		if err != nil {
+			return nil, nil, err
+		}
+		if n := len(ai.free); n > 0 {
+			*aggIdx = ai.free[n-1]
+			ai.free = ai.free[:n-1]
+			ai.active[*aggIdx-1] = agg
+		} else {
+			ai.active = append(ai.active, agg)
+			*aggIdx = int64(len(ai.active))
+		}
+	}
+	return aggIdx, ai.active[*aggIdx-1], nil
+}
+
+func (ai *aggInfo) Step(ctx *C.sqlite3_context, argv []*C.sqlite3_value) {
+	_, agg, err := ai.agg(ctx)
+	if err != nil {
+		callbackError(ctx, err)
 		return
 	}
+	agg.Step((*SQLiteContext)(ctx), *(*[]*SQLiteValue)(unsafe.Pointer(&argv)))
 }
 
 func (ai *aggInfo) Done(ctx *C.sqlite3_context) {
@@ -477,19 +665,29 @@ func (ai *aggInfo) Done(ctx *C.sqlite3_context) {
 		callbackError(ctx, err)
 		return
 	}
-	defer func() { delete(ai.active, idx) }()
+	defer func() {
+		ai.active[*idx-1] = nil
+		ai.free = append(ai.free, *idx)
+	}()
+	agg.Done((*SQLiteContext)(ctx))
+}
 
-	ret := agg.MethodByName("Done").Call(nil)
-	if len(ret) == 2 && ret[1].Interface() != nil {
-		callbackError(ctx, ret[1].Interface().(error))
+func (ai *aggInfo) Value(ctx *C.sqlite3_context) {
+	_, agg, err := ai.agg(ctx)
+	if err != nil {
+		callbackError(ctx, err)
 		return
 	}
+	agg.(RawWindowAggregator).Value((*SQLiteContext)(ctx))
+}
 
-	err = ai.doneRetConverter(ctx, ret[0])
+func (ai *aggInfo) Inverse(ctx *C.sqlite3_context, argv []*C.sqlite3_value) {
+	_, agg, err := ai.agg(ctx)
 	if err != nil {
 		callbackError(ctx, err)
 		return
 	}
+	agg.(RawWindowAggregator).Inverse((*SQLiteContext)(ctx), *(*[]*SQLiteValue)(unsafe.Pointer(&argv)))
 }
 
 // Commit transaction.
@@ -503,13 +701,13 @@ func (tx *SQLiteTx) Commit() error {
 		// to sqlite's docs, there is no harm in calling ROLLBACK unnecessarily.
 		tx.c.exec(context.Background(), "ROLLBACK", nil)
 	}
-	return err
+	return tx.end(err)
 }
 
 // Rollback transaction.
 func (tx *SQLiteTx) Rollback() error {
 	_, err := tx.c.exec(context.Background(), "ROLLBACK", nil)
-	return err
+	return tx.end(err)
 }
 
 // RegisterCollation makes a Go function available as a collation.
@@ -535,18 +733,86 @@ func (c *SQLiteConn) RegisterCollation(name string, cmp func(string, string) int
 	return nil
 }
 
+// RegisterCollationBytes is like RegisterCollation, but cmp receives views
+// of SQLite's buffers instead of copies of the strings, so comparisons do
+// not allocate. a and b must not be modified nor retained after cmp
+// returns.
+func (c *SQLiteConn) RegisterCollationBytes(name string, cmp func(a, b []byte) int) error {
+	handle := newHandle(c, cmp)
+	cname := C.CString(name)
+	defer C.free(unsafe.Pointer(cname))
+	rv := C.sqlite3_create_collation(c.db, cname, C.SQLITE_UTF8, handle, (*[0]byte)(unsafe.Pointer(C.compareTrampoline)))
+	if rv != C.SQLITE_OK {
+		return c.lastError()
+	}
+	return nil
+}
+
+// defaultCollationKeyCache is the number of sort keys RegisterCollationKey
+// caches when cacheSize is not positive.
+const defaultCollationKeyCache = 4096
+
+// RegisterCollationKey makes a collation ordering strings by the byte
+// order of their sort keys, for collations too expensive to evaluate on
+// every comparison. key appends the sort key of s to dst and returns the
+// extended buffer, like the KeyFromString method of
+// golang.org/x/text/collate; s must not be retained.
+//
+// The keys of up to cacheSize strings are kept, so that sorting n rows
+// computes about one key per distinct string instead of two per
+// comparison. The cache is emptied when it is full.
+func (c *SQLiteConn) RegisterCollationKey(name string, key func(dst, s []byte) []byte, cacheSize int) error {
+	if cacheSize <= 0 {
+		cacheSize = defaultCollationKeyCache
+	}
+	ck := &collationKeys{key: key, max: cacheSize, cache: make(map[string]string)}
+	return c.RegisterCollationBytes(name, ck.compare)
+}
+
+// collationKeys caches the sort keys of a RegisterCollationKey collation.
+// Collations run on the connection's thread, so it needs no lock.
+type collationKeys struct {
+	key   func(dst, s []byte) []byte
+	max   int
+	cache map[string]string
+	buf   []byte
+}
+
+func (ck *collationKeys) compare(a, b []byte) int {
+	return strings.Compare(ck.lookup(a), ck.lookup(b))
+}
+
+func (ck *collationKeys) lookup(s []byte) string {
+	if k, ok := ck.cache[string(s)]; ok {
+		return k
+	}
+	ck.buf = ck.key(ck.buf[:0], s)
+	k := string(ck.buf)
+	if len(ck.cache) >= ck.max {
+		ck.cache = make(map[string]string, ck.max)
+	}
+	ck.cache[string(s)] = k
+	return k
+}
+
 // RegisterCommitHook sets the commit hook for a connection.
 //
 // If the callback returns non-zero the transaction will become a rollback.
 //
 // If there is an existing commit hook for this connection, it will be
 // removed. If callback is nil the existing hook (if any) will be removed
-// without creating a new one.
+// without creating a new one. The change feed of the connection, if any,
+// is closed.
 func (c *SQLiteConn) RegisterCommitHook(callback func() int) {
+	c.closeChangeFeed()
+	var prev unsafe.Pointer
 	if callback == nil {
-		C.sqlite3_commit_hook(c.db, nil, nil)
+		prev = C.sqlite3_commit_hook(c.db, nil, nil)
 	} else {
-		C.sqlite3_commit_hook(c.db, (*[0]byte)(C.commitHookTrampoline), newHandle(c, callback))
+		prev = C.sqlite3_commit_hook(c.db, (*[0]byte)(C.commitHookTrampoline), newHandle(c, callback))
+	}
+	if prev != nil {
+		deleteHandle(c, prev)
 	}
 }
 
@@ -554,12 +820,18 @@ func (c *SQLiteConn) RegisterCommitHook(callback func() int) {
 //
 // If there is an existing rollback hook for this connection, it will be
 // removed. If callback is nil the existing hook (if any) will be removed
-// without creating a new one.
+// without creating a new one. The change feed of the connection, if any,
+// is closed.
 func (c *SQLiteConn) RegisterRollbackHook(callback func()) {
+	c.closeChangeFeed()
+	var prev unsafe.Pointer
 	if callback == nil {
-		C.sqlite3_rollback_hook(c.db, nil, nil)
+		prev = C.sqlite3_rollback_hook(c.db, nil, nil)
 	} else {
-		C.sqlite3_rollback_hook(c.db, (*[0]byte)(C.rollbackHookTrampoline), newHandle(c, callback))
+		prev = C.sqlite3_rollback_hook(c.db, (*[0]byte)(C.rollbackHookTrampoline), newHandle(c, callback))
+	}
+	if prev != nil {
+		deleteHandle(c, prev)
 	}
 }
 
@@ -571,12 +843,18 @@ func (c *SQLiteConn) RegisterRollbackHook(callback func()) {
 //
 // If there is an existing update hook for this connection, it will be
 // removed. If callback is nil the existing hook (if any) will be removed
-// without creating a new one.
+// without creating a new one. The change feed of the connection, if any,
+// is closed.
 func (c *SQLiteConn) RegisterUpdateHook(callback func(int, string, string, int64)) {
+	c.closeChangeFeed()
+	var prev unsafe.Pointer
 	if callback == nil {
-		C.sqlite3_update_hook(c.db, nil, nil)
+		prev = C.sqlite3_update_hook(c.db, nil, nil)
 	} else {
-		C.sqlite3_update_hook(c.db, (*[0]byte)(C.updateHookTrampoline), newHandle(c, callback))
+		prev = C.sqlite3_update_hook(c.db, (*[0]byte)(C.updateHookTrampoline), newHandle(c, callback))
+	}
+	if prev != nil {
+		deleteHandle(c, prev)
 	}
 }
 
@@ -587,10 +865,16 @@ func (c *SQLiteConn) RegisterUpdateHook(callback func(int, string, string, int64
 // depending on operation. More details see:
 // https://www.sqlite.org/c3ref/c_alter_table.html
 func (c *SQLiteConn) RegisterAuthorizer(callback func(int, string, string, string) int) {
+	prev := c.authorizer
 	if callback == nil {
 		C.sqlite3_set_authorizer(c.db, nil, nil)
+		c.authorizer = nil
 	} else {
-		C.sqlite3_set_authorizer(c.db, (*[0]byte)(C.authorizerTrampoline), newHandle(c, callback))
+		c.authorizer = newHandle(c, callback)
+		C.sqlite3_set_authorizer(c.db, (*[0]byte)(C.authorizerTrampoline), c.authorizer)
+	}
+	if prev != nil {
+		deleteHandle(c, prev)
 	}
 }
 
@@ -671,6 +955,31 @@ func (c *SQLiteConn) RegisterFunc(name string, impl interface{}, pure bool) erro
 	return nil
 }
 
+// RegisterFuncRaw makes fn available as the SQLite function name, taking
+// nArg arguments or any number of them if nArg is -1.
+//
+// fn reads its arguments and sets its result through the SQLiteValue and
+// SQLiteContext methods, with no reflection nor conversion in between, so
+// it is the cheapest kind of function to call. The arguments are only
+// valid until fn returns. If pure is true, the function is deterministic,
+// as with RegisterFunc.
+func (c *SQLiteConn) RegisterFuncRaw(name string, nArg int, fn func(ctx *SQLiteContext, args []*SQLiteValue), pure bool) error {
+	if fn == nil {
+		return errors.New("nil function passed to RegisterFuncRaw")
+	}
+	cname := C.CString(name)
+	defer C.free(unsafe.Pointer(cname))
+	opts := C.SQLITE_UTF8
+	if pure {
+		opts |= C.SQLITE_DETERMINISTIC
+	}
+	rv := sqlite3CreateFunction(c.db, cname, C.int(nArg), C.int(opts), newHandle(c, &rawFunction{fn}), C.callbackTrampoline, nil, nil)
+	if rv != C.SQLITE_OK {
+		return c.lastError()
+	}
+	return nil
+}
+
 func sqlite3CreateFunction(db *C.sqlite3, zFunctionName *C.char, nArg C.int, eTextRep C.int, pApp unsafe.Pointer, xFunc unsafe.Pointer, xStep unsafe.Pointer, xFinal unsafe.Pointer) C.int {
 	return C._sqlite3_create_function(db, zFunctionName, nArg, eTextRep, C.uintptr_t(uintptr(pApp)), (*[0]byte)(xFunc), (*[0]byte)(xStep), (*[0]byte)(xFinal))
 }
@@ -691,6 +1000,13 @@ func sqlite3CreateFunction(db *C.sqlite3, zFunctionName *C.char, nArg C.int, eTe
 // The constructor function and the Step/Done methods may optionally
 // return an error in addition to their other return values.
 //
+// If the type also has a Value method, with the signature of Done, and an
+// Inverse method, with the signature of Step, the function is registered
+// as an aggregate window function. Value returns the aggregate value of
+// the current window without ending the aggregation, and Inverse removes
+// from it the oldest row passed to Step, so that a sliding window is
+// computed incrementally rather than from scratch for every row.
+//
 // See _example/go_custom_funcs for a detailed example.
 func (c *SQLiteConn) RegisterAggregator(name string, impl interface{}, pure bool) error {
 	var ai aggInfo
@@ -719,6 +1035,7 @@ func (c *SQLiteConn) RegisterAggregator(name string, impl interface{}, pure bool
 	if !found {
 		return errors.New("SQlite aggregator doesn't have a Step() function")
 	}
+	ai.stepMethod = stepFn.Index
 	step := stepFn.Type
 	if step.NumOut() != 0 && step.NumOut() != 1 {
 		return errors.New("SQlite aggregator Step() function must return 0 or 1 values")
@@ -760,6 +1077,7 @@ func (c *SQLiteConn) RegisterAggregator(name string, impl interface{}, pure bool
 	if !found {
 		return errors.New("SQlite aggregator doesn't have a Done() function")
 	}
+	ai.doneMethod = doneFn.Index
 	done := doneFn.Type
 	doneNArgs := done.NumIn()
 	if agg.Kind() == reflect.Ptr {
@@ -781,11 +1099,54 @@ func (c *SQLiteConn) RegisterAggregator(name string, impl interface{}, pure bool
 		return err
 	}
 	ai.doneRetConverter = conv
-	ai.active = make(map[int64]reflect.Value)
-	ai.next = 1
 
+	valueFn, hasValue := agg.MethodByName("Value")
+	inverseFn, hasInverse := agg.MethodByName("Inverse")
+	if hasValue != hasInverse {
+		return errors.New("SQLite aggregator must have both or none of the Value() and Inverse() functions")
+	}
+	if hasValue {
+		if valueFn.Type != done {
+			return errors.New("SQLite aggregator Value() function must have the signature of Done()")
+		}
+		if inverseFn.Type != step {
+			return errors.New("SQLite aggregator Inverse() function must have the signature of Step()")
+		}
+		ai.valueMethod = valueFn.Index
+		ai.inverseMethod = inverseFn.Index
+		ai.window = true
+	}
+
+	return c.registerAggregator(name, stepNArgs, &ai, pure)
+}
+
+// RegisterAggregatorRaw makes an aggregation function available as the
+// SQLite function name, taking nArg arguments or any number of them if
+// nArg is -1. impl is called each time an aggregation begins and returns
+// the state receiving its rows.
+//
+// Rows are passed to the state without reflection nor conversion, which
+// makes it much cheaper than RegisterAggregator for large aggregations.
+func (c *SQLiteConn) RegisterAggregatorRaw(name string, nArg int, impl func() RawAggregator, pure bool) error {
+	if impl == nil {
+		return errors.New("nil constructor passed to RegisterAggregatorRaw")
+	}
+	return c.registerAggregator(name, nArg, &aggInfo{raw: impl}, pure)
+}
+
+// RegisterWindowAggregatorRaw is like RegisterAggregatorRaw for aggregate
+// window functions, see RawWindowAggregator.
+func (c *SQLiteConn) RegisterWindowAggregatorRaw(name string, nArg int, impl func() RawWindowAggregator, pure bool) error {
+	if impl == nil {
+		return errors.New("nil constructor passed to RegisterWindowAggregatorRaw")
+	}
+	raw := func() RawAggregator { return impl() }
+	return c.registerAggregator(name, nArg, &aggInfo{raw: raw, window: true}, pure)
+}
+
+func (c *SQLiteConn) registerAggregator(name string, nArg int, ai *aggInfo, pure bool) error {
 	// ai must outlast the database connection, or we'll have dangling pointers.
-	c.aggregators = append(c.aggregators, &ai)
+	c.aggregators = append(c.aggregators, ai)
 
 	cname := C.CString(name)
 	defer C.free(unsafe.Pointer(cname))
@@ -793,7 +1154,13 @@ func (c *SQLiteConn) RegisterAggregator(name string, impl interface{}, pure bool
 	if pure {
 		opts |= C.SQLITE_DETERMINISTIC
 	}
-	rv := sqlite3CreateFunction(c.db, cname, C.int(stepNArgs), C.int(opts), newHandle(c, &ai), nil, C.stepTrampoline, C.doneTrampoline)
+	var rv C.int
+	if ai.window {
+		rv = C._sqlite3_create_window_function(c.db, cname, C.int(nArg), C.int(opts), C.uintptr_t(uintptr(newHandle(c, ai))),
+			(*[0]byte)(C.stepTrampoline), (*[0]byte)(C.doneTrampoline), (*[0]byte)(C.valueTrampoline), (*[0]byte)(C.inverseTrampoline))
+	} else {
+		rv = sqlite3CreateFunction(c.db, cname, C.int(nArg), C.int(opts), newHandle(c, ai), nil, C.stepTrampoline, C.doneTrampoline)
+	}
 	if rv != C.SQLITE_OK {
 		return c.lastError()
 	}
@@ -851,7 +1218,7 @@ func (c *SQLiteConn) Exec(query string, args []driver.Value) (driver.Result, err
 func (c *SQLiteConn) exec(ctx context.Context, query string, args []driver.NamedValue) (driver.Result, error) {
 	start := 0
 	for {
-		s, err := c.prepare(ctx, query)
+		s, err := c.prepareCached(ctx, query)
 		if err != nil {
 			return nil, err
 		}
@@ -911,7 +1278,7 @@ func (c *SQLiteConn) query(ctx context.Context, query string, args []driver.Name
 	start := 0
 	for {
 		stmtArgs := make([]driver.NamedValue, 0, len(args))
-		s, err := c.prepare(ctx, query)
+		s, err := c.prepareCached(ctx, query)
 		if err != nil {
 			return nil, err
 		}
@@ -957,7 +1324,48 @@ func (c *SQLiteConn) begin(ctx context.Context) (driver.Tx, error) {
 	if _, err := c.exec(ctx, c.txlock, nil); err != nil {
 		return nil, err
 	}
-	return &SQLiteTx{c}, nil
+	return &SQLiteTx{c: c}, nil
+}
+
+// beginTx starts a transaction as requested by opts. A read-only one is
+// deferred, so that it does not take the write lock, and runs with
+// query_only on. Serializable takes the write lock up front with BEGIN
+// IMMEDIATE and Linearizable with BEGIN EXCLUSIVE. Any other level uses
+// _txlock, as SQLite transactions are serializable anyway.
+func (c *SQLiteConn) beginTx(ctx context.Context, opts driver.TxOptions) (driver.Tx, error) {
+	lock := c.txlock
+	switch {
+	case opts.ReadOnly:
+		lock = "BEGIN DEFERRED"
+	case opts.Isolation == driver.IsolationLevel(sql.LevelSerializable):
+		lock = "BEGIN IMMEDIATE"
+	case opts.Isolation == driver.IsolationLevel(sql.LevelLinearizable):
+		lock = "BEGIN EXCLUSIVE"
+	}
+	queryOnly := opts.ReadOnly && !c.queryOnly
+	if queryOnly {
+		if _, err := c.exec(ctx, "PRAGMA query_only = 1", nil); err != nil {
+			return nil, err
+		}
+	}
+	if _, err := c.exec(ctx, lock, nil); err != nil {
+		if queryOnly {
+			c.exec(context.Background(), "PRAGMA query_only = 0", nil)
+		}
+		return nil, err
+	}
+	return &SQLiteTx{c: c, queryOnly: queryOnly}, nil
+}
+
+// end turns query_only back off after a read-only transaction.
+func (tx *SQLiteTx) end(err error) error {
+	if tx.queryOnly {
+		tx.queryOnly = false
+		if _, qerr := tx.c.exec(context.Background(), "PRAGMA query_only = 0", nil); err == nil {
+			err = qerr
+		}
+	}
+	return err
 }
 
 // Open database and return a new connection.
@@ -1009,7 +1417,9 @@ func (c *SQLiteConn) begin(ctx context.Context) (driver.Tx, error) {
 //
 //   _txlock=XXX
 //     Specify locking behavior for transactions.  XXX can be "immediate",
-//     "deferred", "exclusive".
+//     "deferred", "exclusive". BeginTx overrides it for read-only
+//     transactions (deferred) and for the Serializable (immediate) and
+//     Linearizable (exclusive) isolation levels.
 //
 //   _auto_vacuum=X | _vacuum=X
 //     0 | none - Auto Vacuum disabled
@@ -1062,12 +1472,85 @@ func (c *SQLiteConn) begin(ctx context.Context) (driver.Tx, error) {
 //     can be changed using ordinary UPDATE, INSERT, and DELETE statements.
 //     Warning: misuse of this pragma can easily result in a corrupt database file.
 //
+//   _stmt_cache=XXX
+//     Keep up to XXX statements prepared by Exec and Query in a per-connection
+//     LRU cache keyed by SQL text. 0 (the default) disables the cache.
+//
+//   _prefetch_rows=XXX
+//     Step up to XXX rows at a time in C when iterating over query results,
+//     packing their values into one buffer that Next then decodes. 0 (the
+//     default) steps one row per Next.
+//
+//   _bg_checkpoint=XXX
+//     Replace the automatic WAL checkpoint, which runs inline on the commit
+//     that crosses the threshold, with a background goroutine that
+//     checkpoints on its own connection once the WAL holds XXX frames. 0
+//     (the default) keeps the automatic checkpoint. The connections to a
+//     database file must all use the same XXX. See CheckpointStats.
+//
+//   _pool=rw
+//     Share one writer connection and up to _readers query_only reader
+//     connections among all connections opened with the same DSN. Exec and
+//     read-write statements run on the writer, one at a time, and read-only
+//     queries on a reader. A transaction holds the writer, or a reader if it
+//     is read-only, until it ends. Waiting for the writer fails with
+//     ErrBusy after _busy_timeout. Meant for databases in WAL mode.
+//
+//   _readers=XXX
+//     Maximum number of reader connections of a _pool=rw pool. Defaults to
+//     the number of CPUs.
+//
+//   _group_commit=XXX
+//     With _pool=rw, queue Exec calls made outside of a transaction and run
+//     up to XXX of them in one transaction on the writer, each in its own
+//     savepoint, so that they share a single commit. 0 (the default)
+//     executes every call on its own.
+//
+//   _group_commit_delay=XXX
+//     How long the first queued Exec waits for others to join its
+//     transaction, as a duration such as 500us. The default, 0, only groups
+//     the calls that queued up while the writer was busy.
+//
+//   _mmap_size=XXX
+//     Use memory-mapped I/O for up to XXX bytes of the database file.
+//     https://www.sqlite.org/pragma.html#pragma_mmap_size
+//
+//   _time_format=text|unixnano|unixmilli|julianday
+//     Store time.Time arguments as text (the default, SQLiteTimestampFormats[0]),
+//     as INTEGER nanoseconds or milliseconds since the Unix epoch, or as a
+//     REAL Julian day number. Columns declared as date, datetime or timestamp
+//     read numbers back in the same unit; text is always parsed.
+//
+//   _soft_heap_limit=XXX
+//     Set the process-wide soft heap limit to XXX bytes when the connection
+//     is opened, see SetSoftHeapLimit.
+//
+//   _hard_heap_limit=XXX
+//     Set the process-wide hard heap limit to XXX bytes when the connection
+//     is opened, see SetHardHeapLimit.
+//
+//   _lookaside=SIZE,COUNT
+//     Give the connection a lookaside allocator of COUNT slots of SIZE
+//     bytes, see ConfigLookaside. 0,0 disables it.
+//
+//   _pagecache=SIZE,COUNT
+//     Preallocate a page cache arena of COUNT pages of up to SIZE bytes for
+//     all connections, see ConfigPageCache. Only the first connection opened
+//     can set it; later ones must leave it out or repeat the same value.
+//
 //
 func (d *SQLiteDriver) Open(dsn string) (driver.Conn, error) {
 	if C.sqlite3_threadsafe() == 0 {
 		return nil, errors.New("sqlite library was not compiled for thread-safe operation")
 	}
 
+	// Reader/writer pool (_pool, _readers)
+	if cfg, err := poolParams(dsn); err != nil {
+		return nil, err
+	} else if cfg.readers > 0 {
+		return d.openPool(cfg)
+	}
+
 	var pkey string
 
 	// Options
@@ -1096,6 +1579,14 @@ func (d *SQLiteDriver) Open(dsn string) (driver.Conn, error) {
 	writableSchema := -1
 	vfsName := ""
 	var cacheSize *int64
+	var mmapSize *int64
+	stmtCacheSize := 0
+	prefetchRows := 0
+	timeFormat := timeFormatText
+	bgCheckpoint := 0
+	bgCheckpointDSN := ""
+	lookaside := false
+	var lookasideSize, lookasideCount int
 
 	pos := strings.IndexRune(dsn, '?')
 	if pos >= 1 {
@@ -1431,6 +1922,87 @@ func (d *SQLiteDriver) Open(dsn string) (driver.Conn, error) {
 			cacheSize = &iv
 		}
 
+		// Memory-mapped I/O (_mmap_size)
+		//
+		// https://sqlite.org/pragma.html#pragma_mmap_size
+		//
+		if val := params.Get("_mmap_size"); val != "" {
+			iv, err := strconv.ParseInt(val, 10, 64)
+			if err != nil || iv < 0 {
+				return nil, fmt.Errorf("Invalid _mmap_size: %v, expecting a non-negative integer", val)
+			}
+			mmapSize = &iv
+		}
+
+		// Statement cache (_stmt_cache)
+		if val := params.Get("_stmt_cache"); val != "" {
+			iv, err := strconv.ParseInt(val, 10, 64)
+			if err != nil || iv < 0 {
+				return nil, fmt.Errorf("Invalid _stmt_cache: %v, expecting a non-negative integer", val)
+			}
+			stmtCacheSize = int(iv)
+		}
+
+		// Row prefetching (_prefetch_rows)
+		if val := params.Get("_prefetch_rows"); val != "" {
+			iv, err := strconv.ParseInt(val, 10, 32)
+			if err != nil || iv < 0 {
+				return nil, fmt.Errorf("Invalid _prefetch_rows: %v, expecting a non-negative integer", val)
+			}
+			prefetchRows = int(iv)
+		}
+
+		// Background WAL checkpoints (_bg_checkpoint)
+		if val := params.Get("_bg_checkpoint"); val != "" {
+			iv, err := strconv.ParseInt(val, 10, 32)
+			if err != nil || iv < 0 {
+				return nil, fmt.Errorf("Invalid _bg_checkpoint: %v, expecting a non-negative integer", val)
+			}
+			bgCheckpoint = int(iv)
+			bgCheckpointDSN = checkpointerDSN(dsn[:pos], params)
+		}
+
+		// Time storage format (_time_format)
+		if val := params.Get("_time_format"); val != "" {
+			if timeFormat, err = parseTimeFormat(val); err != nil {
+				return nil, err
+			}
+		}
+
+		// Allocators (_lookaside, _pagecache), configured before anything
+		// that initializes SQLite, such as the heap limits below
+		if val := params.Get("_lookaside"); val != "" {
+			if lookasideSize, lookasideCount, err = parseAllocPair("_lookaside", val); err != nil {
+				return nil, err
+			}
+			lookaside = true
+		}
+		if val := params.Get("_pagecache"); val != "" {
+			size, count, err := parseAllocPair("_pagecache", val)
+			if err != nil {
+				return nil, err
+			}
+			if err := ConfigPageCache(size, count); err != nil {
+				return nil, err
+			}
+		}
+
+		// Process-wide heap limits (_soft_heap_limit, _hard_heap_limit)
+		if val := params.Get("_soft_heap_limit"); val != "" {
+			iv, err := strconv.ParseInt(val, 10, 64)
+			if err != nil || iv < 0 {
+				return nil, fmt.Errorf("Invalid _soft_heap_limit: %v, expecting a non-negative integer", val)
+			}
+			SetSoftHeapLimit(iv)
+		}
+		if val := params.Get("_hard_heap_limit"); val != "" {
+			iv, err := strconv.ParseInt(val, 10, 64)
+			if err != nil || iv < 0 {
+				return nil, fmt.Errorf("Invalid _hard_heap_limit: %v, expecting a non-negative integer", val)
+			}
+			SetHardHeapLimit(iv)
+		}
+
 		if val := params.Get("vfs"); val != "" {
 			vfsName = val
 		}
@@ -1464,6 +2036,14 @@ func (d *SQLiteDriver) Open(dsn string) (driver.Conn, error) {
 		return nil, errors.New("sqlite succeeded without returning a database")
 	}
 
+	// Lookaside, before anything is allocated from it
+	if lookaside {
+		if err := setLookaside(db, lookasideSize, lookasideCount); err != nil {
+			C.sqlite3_close_v2(db)
+			return nil, err
+		}
+	}
+
 	exec := func(s string) error {
 		cs := C.CString(s)
 		rv := C.sqlite3_exec(db, cs, nil, nil, nil)
@@ -1503,7 +2083,10 @@ func (d *SQLiteDriver) Open(dsn string) (driver.Conn, error) {
 	//
 
 	// Create connection to SQLite
-	conn := &SQLiteConn{db: db, loc: loc, txlock: txlock}
+	conn := &SQLiteConn{db: db, loc: loc, txlock: txlock, queryOnly: queryOnly == 1, prefetchRows: prefetchRows, timeFormat: timeFormat}
+	if stmtCacheSize > 0 {
+		conn.stmtCache = newStmtCache(stmtCacheSize)
+	}
 
 	// Password Cipher has to be registered before authentication
 	if len(authCrypt) > 0 {
@@ -1751,6 +2334,30 @@ func (d *SQLiteDriver) Open(dsn string) (driver.Conn, error) {
 		}
 	}
 
+	// Memory-mapped I/O
+	if mmapSize != nil {
+		if err := exec(fmt.Sprintf("PRAGMA mmap_size = %d;", *mmapSize)); err != nil {
+			C.sqlite3_close_v2(db)
+			return nil, err
+		}
+	}
+
+	// Background WAL checkpoints; the hook replaces the automatic one.
+	if bgCheckpoint > 0 {
+		name := C.CString("main")
+		filename := C.GoString(C.sqlite3_db_filename(db, name))
+		C.free(unsafe.Pointer(name))
+		if filename != "" {
+			cp, err := acquireCheckpointer(filename, bgCheckpointDSN, bgCheckpoint)
+			if err != nil {
+				conn.Close()
+				return nil, err
+			}
+			conn.checkpointer = cp
+			cp.install(conn)
+		}
+	}
+
 	if len(d.Extensions) > 0 {
 		if err := conn.loadExtensions(d.Extensions); err != nil {
 			conn.Close()
@@ -1764,12 +2371,34 @@ func (d *SQLiteDriver) Open(dsn string) (driver.Conn, error) {
 			return nil, err
 		}
 	}
+	if mutex == C.SQLITE_OPEN_FULLMUTEX {
+		d.track(conn)
+	}
 	runtime.SetFinalizer(conn, (*SQLiteConn).Close)
 	return conn, nil
 }
 
 // Close the connection.
 func (c *SQLiteConn) Close() error {
+	if c.stmtCache != nil {
+		c.stmtCache.close()
+	}
+	c.mu.Lock()
+	if c.watcher != nil {
+		c.watcher.close()
+		c.watcher = nil
+	}
+	c.mu.Unlock()
+	if c.checkpointer != nil {
+		C.sqlite3_wal_hook(c.db, nil, nil)
+		c.checkpointer.release()
+		c.checkpointer = nil
+	}
+	c.closeChangeFeed()
+	if c.driver != nil {
+		c.driver.untrack(c)
+		c.driver = nil
+	}
 	rv := C.sqlite3_close_v2(c.db)
 	if rv != C.SQLITE_OK {
 		return c.lastError()
@@ -1797,11 +2426,24 @@ func (c *SQLiteConn) Prepare(query string) (driver.Stmt, error) {
 }
 
 func (c *SQLiteConn) prepare(ctx context.Context, query string) (driver.Stmt, error) {
+	s, err := c.prepareStmt(query, false)
+	if err != nil {
+		return nil, err
+	}
+	return s, nil
+}
+
+func (c *SQLiteConn) prepareStmt(query string, persistent bool) (*SQLiteStmt, error) {
 	pquery := C.CString(query)
 	defer C.free(unsafe.Pointer(pquery))
 	var s *C.sqlite3_stmt
 	var tail *C.char
-	rv := C._sqlite3_prepare_v2_internal(c.db, pquery, C.int(-1), &s, &tail)
+	var rv C.int
+	if persistent {
+		rv = C._sqlite3_prepare_persistent(c.db, pquery, C.int(-1), &s, &tail)
+	} else {
+		rv = C._sqlite3_prepare_v2_internal(c.db, pquery, C.int(-1), &s, &tail)
+	}
 	if rv != C.SQLITE_OK {
 		return nil, c.lastError()
 	}
@@ -1855,6 +2497,30 @@ func (c *SQLiteConn) SetLimit(id int, newVal int) int {
 	return int(C._sqlite3_limit(c.db, C.int(id), C.int(newVal)))
 }
 
+// SetMmapSize sets the maximum number of bytes of the main database file
+// read through memory-mapped I/O and returns the limit in effect, which is
+// capped by SQLITE_MAX_MMAP_SIZE. 0 disables memory-mapped I/O. Unlike
+// SQLITE_FCNTL_MMAP_SIZE, which only changes the limit of the file, it
+// also makes the pager start or stop fetching pages from the mapping.
+// See: https://www.sqlite.org/pragma.html#pragma_mmap_size
+func (c *SQLiteConn) SetMmapSize(size int64) (int64, error) {
+	rows, err := c.query(context.Background(), fmt.Sprintf("PRAGMA mmap_size = %d", size), nil)
+	if err != nil {
+		return 0, err
+	}
+	defer rows.Close()
+	dest := make([]driver.Value, 1)
+	if err = rows.Next(dest); err != nil {
+		if err == io.EOF {
+			// SQLite was built without memory-mapped I/O.
+			return 0, nil
+		}
+		return 0, err
+	}
+	n, _ := dest[0].(int64)
+	return n, nil
+}
+
 // SetFileControlInt invokes the xFileControl method on a given database. The
 // dbName is the name of the database. It will default to "main" if left blank.
 // The op is one of the opcodes prefixed by "SQLITE_FCNTL_". The arg argument
@@ -1865,6 +2531,12 @@ func (c *SQLiteConn) SetLimit(id int, newVal int) int {
 //
 // See: sqlite3_file_control, https://www.sqlite.org/c3ref/file_control.html
 func (c *SQLiteConn) SetFileControlInt(dbName string, op int, arg int) error {
+	switch op {
+	case SQLITE_FCNTL_SIZE_HINT, SQLITE_FCNTL_MMAP_SIZE:
+		// These opcodes take a sqlite3_int64.
+		_, err := c.SetFileControlInt64(dbName, op, int64(arg))
+		return err
+	}
 	if dbName == "" {
 		dbName = "main"
 	}
@@ -1880,11 +2552,34 @@ func (c *SQLiteConn) SetFileControlInt(dbName string, op int, arg int) error {
 	return nil
 }
 
+// SetFileControlInt64 is like SetFileControlInt for the opcodes that take
+// a sqlite3_int64, such as SQLITE_FCNTL_MMAP_SIZE, and returns the value
+// the opcode stored back into its argument. For SQLITE_FCNTL_MMAP_SIZE it
+// is the previous limit, or the current one when arg is negative.
+func (c *SQLiteConn) SetFileControlInt64(dbName string, op int, arg int64) (int64, error) {
+	if dbName == "" {
+		dbName = "main"
+	}
+
+	cDBName := C.CString(dbName)
+	defer C.free(unsafe.Pointer(cDBName))
+
+	cArg := C.sqlite3_int64(arg)
+	rv := C.sqlite3_file_control(c.db, cDBName, C.int(op), unsafe.Pointer(&cArg))
+	if rv != C.SQLITE_OK {
+		return 0, c.lastError()
+	}
+	return int64(cArg), nil
+}
+
 // Close the statement.
 func (s *SQLiteStmt) Close() error {
 	s.mu.Lock()
 	defer s.mu.Unlock()
-	if s.closed {
+	if s.closed || s.idle {
+		return nil
+	}
+	if s.cache != nil && s.cache.put(s) {
 		return nil
 	}
 	s.closed = true
@@ -1893,6 +2588,8 @@ func (s *SQLiteStmt) Close() error {
 	}
 	rv := C.sqlite3_finalize(s.s)
 	s.s = nil
+	s.batch.free()
+	s.c.publishChanges()
 	if rv != C.SQLITE_OK {
 		return s.c.lastError()
 	}
@@ -1907,41 +2604,73 @@ func (s *SQLiteStmt) NumInput() int {
 
 var placeHolder = []byte{0}
 
+var namedPrefixes = [3]byte{':', '@', '$'}
+
+// namedIndices returns the parameter indexes of name for each of the ":",
+// "@" and "$" prefixes, 0 where the statement has no such parameter. The
+// lookup is memoized since it does not change for the life of the statement.
+func (s *SQLiteStmt) namedIndices(name string) [3]int {
+	if idx, ok := s.named[name]; ok {
+		return idx
+	}
+	var idx [3]int
+	cname := (*[1 << 30]byte)(C.malloc(C.size_t(len(name) + 2)))
+	copy(cname[1:], name)
+	cname[len(name)+1] = 0
+	for j, prefix := range namedPrefixes {
+		cname[0] = prefix
+		idx[j] = int(C.sqlite3_bind_parameter_index(s.s, (*C.char)(unsafe.Pointer(cname))))
+	}
+	C.free(unsafe.Pointer(cname))
+	if s.named == nil {
+		s.named = make(map[string][3]int)
+	}
+	s.named[name] = idx
+	return idx
+}
+
+// stringData returns a pointer to the bytes of a non-empty string without
+// copying them.
+func stringData(v string) unsafe.Pointer {
+	return unsafe.Pointer((*reflect.StringHeader)(unsafe.Pointer(&v)).Data)
+}
+
 func (s *SQLiteStmt) bind(args []driver.NamedValue) error {
+	return s.bindPinned(args, nil)
+}
+
+// bindPinned binds args to the statement. Strings and byte slices are passed
+// to SQLite without an intermediate Go copy. When pins is not nil the memory
+// of large ones is pinned and bound with SQLITE_STATIC so SQLite does not
+// copy them either; the caller must then clear the bindings and unpin once
+// the statement has been stepped.
+func (s *SQLiteStmt) bindPinned(args []driver.NamedValue, pins *bindPins) error {
 	rv := C.sqlite3_reset(s.s)
 	if rv != C.SQLITE_ROW && rv != C.SQLITE_OK && rv != C.SQLITE_DONE {
 		return s.c.lastError()
 	}
 
-	bindIndices := make([][3]int, len(args))
-	prefixes := []string{":", "@", "$"}
-	for i, v := range args {
-		bindIndices[i][0] = args[i].Ordinal
-		if v.Name != "" {
-			for j := range prefixes {
-				cname := C.CString(prefixes[j] + v.Name)
-				bindIndices[i][j] = int(C.sqlite3_bind_parameter_index(s.s, cname))
-				C.free(unsafe.Pointer(cname))
-			}
-			args[i].Ordinal = bindIndices[i][0]
-		}
-	}
-
 	for i, arg := range args {
-		for j := range bindIndices[i] {
-			if bindIndices[i][j] == 0 {
+		bindIndices := [3]int{arg.Ordinal}
+		if arg.Name != "" {
+			bindIndices = s.namedIndices(arg.Name)
+			args[i].Ordinal = bindIndices[0]
+		}
+		for j := range bindIndices {
+			if bindIndices[j] == 0 {
 				continue
 			}
-			n := C.int(bindIndices[i][j])
+			n := C.int(bindIndices[j])
 			switch v := arg.Value.(type) {
 			case nil:
 				rv = C.sqlite3_bind_null(s.s, n)
 			case string:
 				if len(v) == 0 {
 					rv = C._sqlite3_bind_text(s.s, n, (*C.char)(unsafe.Pointer(&placeHolder[0])), C.int(0))
+				} else if p := stringData(v); pins != nil && pins.pin(p, len(v)) {
+					rv = C._sqlite3_bind_text_static(s.s, n, (*C.char)(p), C.int(len(v)))
 				} else {
-					b := []byte(v)
-					rv = C._sqlite3_bind_text(s.s, n, (*C.char)(unsafe.Pointer(&b[0])), C.int(len(b)))
+					rv = C._sqlite3_bind_text(s.s, n, (*C.char)(p), C.int(len(v)))
 				}
 			case int64:
 				rv = C.sqlite3_bind_int64(s.s, n, C.sqlite3_int64(v))
@@ -1961,11 +2690,28 @@ func (s *SQLiteStmt) bind(args []driver.NamedValue) error {
 					if ln == 0 {
 						v = placeHolder
 					}
-					rv = C._sqlite3_bind_blob(s.s, n, unsafe.Pointer(&v[0]), C.int(ln))
+					if p := unsafe.Pointer(&v[0]); pins != nil && pins.pin(p, ln) {
+						rv = C._sqlite3_bind_blob_static(s.s, n, p, C.int(ln))
+					} else {
+						rv = C._sqlite3_bind_blob(s.s, n, p, C.int(ln))
+					}
 				}
 			case time.Time:
-				b := []byte(v.Format(SQLiteTimestampFormats[0]))
-				rv = C._sqlite3_bind_text(s.s, n, (*C.char)(unsafe.Pointer(&b[0])), C.int(len(b)))
+				switch s.c.timeFormat {
+				case timeFormatUnixNano:
+					ns, err := unixNano(v)
+					if err != nil {
+						return err
+					}
+					rv = C.sqlite3_bind_int64(s.s, n, C.sqlite3_int64(ns))
+				case timeFormatUnixMilli:
+					rv = C.sqlite3_bind_int64(s.s, n, C.sqlite3_int64(unixMilli(v)))
+				case timeFormatJulianDay:
+					rv = C.sqlite3_bind_double(s.s, n, C.double(julianDay(v)))
+				default:
+					b := []byte(v.Format(SQLiteTimestampFormats[0]))
+					rv = C._sqlite3_bind_text(s.s, n, (*C.char)(unsafe.Pointer(&b[0])), C.int(len(b)))
+				}
 			}
 			if rv != C.SQLITE_OK {
 				return s.c.lastError()
@@ -2001,6 +2747,10 @@ func (s *SQLiteStmt) query(ctx context.Context, args []driver.NamedValue) (drive
 		closed:   false,
 		ctx:      ctx,
 	}
+	if done := ctx.Done(); done != nil {
+		rows.done = done
+		rows.watch = s.c.watchCancel(ctx)
+	}
 
 	return rows, nil
 }
@@ -2035,41 +2785,147 @@ func isInterruptErr(err error) bool {
 	return false
 }
 
-// exec executes a query that doesn't return rows. Attempts to honor context timeout.
-func (s *SQLiteStmt) exec(ctx context.Context, args []driver.NamedValue) (driver.Result, error) {
-	if ctx.Done() == nil {
-		return s.execSync(args)
+// ctxWatcher interrupts the connection when the context of a running
+// statement is done. A single goroutine per connection serves one watch at
+// a time; it does not reference the SQLiteConn, so an abandoned connection
+// can still be finalized.
+type ctxWatcher struct {
+	mu       sync.Mutex
+	db       *C.sqlite3 // nil once the connection is closed
+	watch    chan context.Context
+	finished chan struct{}
+	closed   chan struct{}
+	busy     int32
+}
+
+func newCtxWatcher(db *C.sqlite3) *ctxWatcher {
+	w := &ctxWatcher{
+		db:       db,
+		watch:    make(chan context.Context),
+		finished: make(chan struct{}),
+		closed:   make(chan struct{}),
+	}
+	go w.run()
+	return w
+}
+
+func (w *ctxWatcher) run() {
+	for {
+		var ctx context.Context
+		select {
+		case ctx = <-w.watch:
+		case <-w.closed:
+			return
+		}
+		select {
+		case <-ctx.Done():
+			w.interrupt()
+			select {
+			case <-w.finished:
+			case <-w.closed:
+				return
+			}
+		case <-w.finished:
+		case <-w.closed:
+			return
+		}
+	}
+}
+
+func (w *ctxWatcher) interrupt() {
+	w.mu.Lock()
+	if w.db != nil {
+		C.sqlite3_interrupt(w.db)
 	}
+	w.mu.Unlock()
+}
 
-	type result struct {
-		r   driver.Result
-		err error
+func (w *ctxWatcher) close() {
+	w.mu.Lock()
+	w.db = nil
+	w.mu.Unlock()
+	close(w.closed)
+}
+
+// cancelWatch is an active watch returned by watchCancel.
+type cancelWatch struct {
+	w    *ctxWatcher   // set when served by the connection's watcher
+	done chan struct{} // set when served by a goroutine of its own
+}
+
+// watchCancel interrupts the connection if ctx is done before the returned
+// watch is stopped. Overlapping watches, such as an Exec issued while
+// iterating over Rows, fall back to a goroutine each.
+func (c *SQLiteConn) watchCancel(ctx context.Context) cancelWatch {
+	c.mu.Lock()
+	if c.watcher == nil && c.db != nil {
+		c.watcher = newCtxWatcher(c.db)
+	}
+	w := c.watcher
+	c.mu.Unlock()
+	if w == nil {
+		return cancelWatch{}
+	}
+	if atomic.CompareAndSwapInt32(&w.busy, 0, 1) {
+		select {
+		case w.watch <- ctx:
+			return cancelWatch{w: w}
+		case <-w.closed:
+			return cancelWatch{}
+		}
 	}
-	resultCh := make(chan result)
+	done := make(chan struct{})
 	go func() {
-		r, err := s.execSync(args)
-		resultCh <- result{r, err}
+		select {
+		case <-ctx.Done():
+			w.interrupt()
+		case <-done:
+		case <-w.closed:
+		}
 	}()
-	var rv result
-	select {
-	case rv = <-resultCh:
-	case <-ctx.Done():
+	return cancelWatch{done: done}
+}
+
+// stop ends the watch. Once it returns the connection will no longer be
+// interrupted on behalf of it.
+func (cw *cancelWatch) stop() {
+	if cw.w != nil {
 		select {
-		case rv = <-resultCh: // no need to interrupt, operation completed in db
-		default:
-			// this is still racy and can be no-op if executed between sqlite3_* calls in execSync.
-			C.sqlite3_interrupt(s.c.db)
-			rv = <-resultCh // wait for goroutine completed
-			if isInterruptErr(rv.err) {
-				return nil, ctx.Err()
-			}
+		case cw.w.finished <- struct{}{}:
+		case <-cw.w.closed:
 		}
+		atomic.StoreInt32(&cw.w.busy, 0)
+		cw.w = nil
+	} else if cw.done != nil {
+		close(cw.done)
+		cw.done = nil
 	}
-	return rv.r, rv.err
+}
+
+// exec executes a query that doesn't return rows. Attempts to honor context timeout.
+func (s *SQLiteStmt) exec(ctx context.Context, args []driver.NamedValue) (driver.Result, error) {
+	if ctx.Done() == nil {
+		return s.execSync(args)
+	}
+	if err := ctx.Err(); err != nil {
+		return nil, err
+	}
+
+	watch := s.c.watchCancel(ctx)
+	r, err := s.execSync(args)
+	watch.stop()
+	if err != nil && isInterruptErr(err) && ctx.Err() != nil {
+		return nil, ctx.Err()
+	}
+	return r, err
 }
 
 func (s *SQLiteStmt) execSync(args []driver.NamedValue) (driver.Result, error) {
-	if err := s.bind(args); err != nil {
+	// The statement is reset and its bindings cleared before execSync
+	// returns, so the arguments can be bound in place for the single step.
+	pins := &s.pins
+	defer pins.unpin()
+	if err := s.bindPinned(args, pins); err != nil {
 		C.sqlite3_reset(s.s)
 		C.sqlite3_clear_bindings(s.s)
 		return nil, err
@@ -2077,6 +2933,11 @@ func (s *SQLiteStmt) execSync(args []driver.NamedValue) (driver.Result, error) {
 
 	var rowid, changes C.longlong
 	rv := C._sqlite3_step_row_internal(s.s, &rowid, &changes)
+	s.c.publishChanges()
+	if pins.pinned() && (rv == C.SQLITE_ROW || rv == C.SQLITE_OK || rv == C.SQLITE_DONE) {
+		C.sqlite3_reset(s.s)
+		C.sqlite3_clear_bindings(s.s)
+	}
 	if rv != C.SQLITE_ROW && rv != C.SQLITE_OK && rv != C.SQLITE_DONE {
 		err := s.c.lastError()
 		C.sqlite3_reset(s.s)
@@ -2102,11 +2963,13 @@ func (rc *SQLiteRows) Close() error {
 		return nil
 	}
 	rc.closed = true
+	rc.watch.stop()
 	if rc.cls {
 		rc.s.mu.Unlock()
 		return rc.s.Close()
 	}
 	rv := C.sqlite3_reset(rc.s.s)
+	rc.s.c.publishChanges()
 	if rv != C.SQLITE_OK {
 		rc.s.mu.Unlock()
 		return rc.s.c.lastError()
@@ -2131,8 +2994,10 @@ func (rc *SQLiteRows) Columns() []string {
 func (rc *SQLiteRows) declTypes() []string {
 	if rc.s.s != nil && rc.decltype == nil {
 		rc.decltype = make([]string, rc.nc)
+		rc.decoders = make([]columnDecoder, rc.nc)
 		for i := 0; i < rc.nc; i++ {
 			rc.decltype[i] = strings.ToLower(C.GoString(C.sqlite3_column_decltype(rc.s.s, C.int(i))))
+			rc.decoders[i] = newColumnDecoder(rc.decltype[i], rc.s.c.timeFormat)
 		}
 	}
 	return rc.decltype
@@ -2154,31 +3019,31 @@ func (rc *SQLiteRows) Next(dest []driver.Value) error {
 		return io.EOF
 	}
 
-	if rc.ctx.Done() == nil {
+	if rc.done == nil {
 		return rc.nextSyncLocked(dest)
 	}
-	resultCh := make(chan error)
-	go func() {
-		resultCh <- rc.nextSyncLocked(dest)
-	}()
+	// The connection's watcher interrupts a step that is running when the
+	// context is done; rows already stepped must not be handed out either.
 	select {
-	case err := <-resultCh:
-		return err
-	case <-rc.ctx.Done():
-		select {
-		case <-resultCh: // no need to interrupt
-		default:
-			// this is still racy and can be no-op if executed between sqlite3_* calls in nextSyncLocked.
-			C.sqlite3_interrupt(rc.s.c.db)
-			<-resultCh // ensure goroutine completed
-		}
+	case <-rc.done:
+		return rc.ctx.Err()
+	default:
+	}
+	err := rc.nextSyncLocked(dest)
+	if err != nil && isInterruptErr(err) && rc.ctx.Err() != nil {
 		return rc.ctx.Err()
 	}
+	return err
 }
 
 // nextSyncLocked moves cursor to next; must be called with locked mutex.
 func (rc *SQLiteRows) nextSyncLocked(dest []driver.Value) error {
+	if rc.s.c.prefetchRows > 0 {
+		return rc.nextBatchLocked(dest)
+	}
+
 	rv := C._sqlite3_step_internal(rc.s.s)
+	rc.s.c.publishChanges()
 	if rv == C.SQLITE_DONE {
 		return io.EOF
 	}
@@ -2195,30 +3060,9 @@ func (rc *SQLiteRows) nextSyncLocked(dest []driver.Value) error {
 	for i := range dest {
 		switch C.sqlite3_column_type(rc.s.s, C.int(i)) {
 		case C.SQLITE_INTEGER:
-			val := int64(C.sqlite3_column_int64(rc.s.s, C.int(i)))
-			switch rc.decltype[i] {
-			case columnTimestamp, columnDatetime, columnDate:
-				var t time.Time
-				// Assume a millisecond unix timestamp if it's 13 digits -- too
-				// large to be a reasonable timestamp in seconds.
-				if val > 1e12 || val < -1e12 {
-					val *= int64(time.Millisecond) // convert ms to nsec
-					t = time.Unix(0, val)
-				} else {
-					t = time.Unix(val, 0)
-				}
-				t = t.UTC()
-				if rc.s.c.loc != nil {
-					t = t.In(rc.s.c.loc)
-				}
-				dest[i] = t
-			case "boolean":
-				dest[i] = val > 0
-			default:
-				dest[i] = val
-			}
+			dest[i] = rc.intValue(i, int64(C.sqlite3_column_int64(rc.s.s, C.int(i))))
 		case C.SQLITE_FLOAT:
-			dest[i] = float64(C.sqlite3_column_double(rc.s.s, C.int(i)))
+			dest[i] = rc.floatValue(i, float64(C.sqlite3_column_double(rc.s.s, C.int(i))))
 		case C.SQLITE_BLOB:
 			p := C.sqlite3_column_blob(rc.s.s, C.int(i))
 			if p == nil {
@@ -2230,34 +3074,53 @@ func (rc *SQLiteRows) nextSyncLocked(dest []driver.Value) error {
 		case C.SQLITE_NULL:
 			dest[i] = nil
 		case C.SQLITE_TEXT:
-			var err error
-			var timeVal time.Time
-
 			n := int(C.sqlite3_column_bytes(rc.s.s, C.int(i)))
 			s := C.GoStringN((*C.char)(unsafe.Pointer(C.sqlite3_column_text(rc.s.s, C.int(i)))), C.int(n))
-
-			switch rc.decltype[i] {
-			case columnTimestamp, columnDatetime, columnDate:
-				var t time.Time
-				s = strings.TrimSuffix(s, "Z")
-				for _, format := range SQLiteTimestampFormats {
-					if timeVal, err = time.ParseInLocation(format, s, time.UTC); err == nil {
-						t = timeVal
-						break
-					}
-				}
-				if err != nil {
-					// The column is a time value, so return the zero time on parse failure.
-					t = time.Time{}
-				}
-				if rc.s.c.loc != nil {
-					t = t.In(rc.s.c.loc)
-				}
-				dest[i] = t
-			default:
-				dest[i] = s
-			}
+			dest[i] = rc.textValue(i, s)
 		}
 	}
 	return nil
-}
\ No newline at end of file
+}
+
+// intValue converts an INTEGER column value according to its declared type.
+func (rc *SQLiteRows) intValue(i int, val int64) driver.Value {
+	switch rc.decoders[i].kind {
+	case decodeTime:
+		t := rc.decoders[i].intTime(val)
+		if rc.s.c.loc != nil {
+			t = t.In(rc.s.c.loc)
+		}
+		return t
+	case decodeBool:
+		return val > 0
+	default:
+		return val
+	}
+}
+
+// floatValue converts a FLOAT column value according to its declared type.
+func (rc *SQLiteRows) floatValue(i int, val float64) driver.Value {
+	if d := &rc.decoders[i]; d.kind == decodeTime && d.storage == timeFormatJulianDay {
+		t := fromJulianDay(val)
+		if rc.s.c.loc != nil {
+			t = t.In(rc.s.c.loc)
+		}
+		return t
+	}
+	return val
+}
+
+// textValue converts a TEXT column value according to its declared type.
+func (rc *SQLiteRows) textValue(i int, s string) driver.Value {
+	switch rc.decoders[i].kind {
+	case decodeTime:
+		// The column is a time value, so return the zero time on parse failure.
+		t, _ := rc.decoders[i].parseTime(s)
+		if rc.s.c.loc != nil {
+			t = t.In(rc.s.c.loc)
+		}
+		return t
+	default:
+		return s
+	}
+}
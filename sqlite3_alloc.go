@@ -0,0 +1,111 @@
+// Copyright (C) 2019 Yasuhiro Matsumoto <mattn.jp@gmail.com>.
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file.
+
+//go:build cgo
+// +build cgo
+
+package sqlite3
+
+/*
+#ifndef USE_LIBSQLITE3
+#include "sqlite3-binding.h"
+#else
+#include <sqlite3.h>
+#endif
+
+static int
+_sqlite3_db_config_lookaside(sqlite3 *db, int sz, int cnt) {
+  return sqlite3_db_config(db, SQLITE_DBCONFIG_LOOKASIDE, (void*)0, sz, cnt);
+}
+
+static int
+_sqlite3_config_lookaside(int sz, int cnt) {
+  return sqlite3_config(SQLITE_CONFIG_LOOKASIDE, sz, cnt);
+}
+
+static int
+_sqlite3_config_pagecache(int sz, int n) {
+  int hdr = 0;
+  int rv = sqlite3_config(SQLITE_CONFIG_PCACHE_HDRSZ, &hdr);
+  if (rv != SQLITE_OK) {
+    return rv;
+  }
+  return sqlite3_config(SQLITE_CONFIG_PAGECACHE, (void*)0, sz + hdr, n);
+}
+*/
+import "C"
+import (
+	"errors"
+	"fmt"
+	"strconv"
+	"strings"
+	"sync"
+)
+
+// allocConfig records the process-wide allocator settings, which can only
+// be changed before SQLite is initialized by the first connection.
+var allocConfig struct {
+	sync.Mutex
+	pageCache [2]int
+}
+
+var errAlreadyInitialized = errors.New("sqlite3: the allocator must be configured before the first connection is opened")
+
+// ConfigLookaside sets the default lookaside allocator of new connections:
+// count slots of size bytes from which each connection serves its small,
+// short-lived allocations without calling malloc. 0 disables it. It must
+// be called before the first connection is opened; the _lookaside DSN
+// parameter overrides it for a connection.
+func ConfigLookaside(size, count int) error {
+	if C._sqlite3_config_lookaside(C.int(size), C.int(count)) != C.SQLITE_OK {
+		return errAlreadyInitialized
+	}
+	return nil
+}
+
+// ConfigPageCache preallocates, when SQLite is initialized, an arena of
+// count pages of up to pageSize bytes shared by the page caches of all
+// connections. Pages that do not fit are allocated from the heap, see
+// MemoryStats.PagecacheOverflow. It must be called before the first
+// connection is opened, or through the _pagecache DSN parameter of the
+// first connection.
+func ConfigPageCache(pageSize, count int) error {
+	allocConfig.Lock()
+	defer allocConfig.Unlock()
+	return configPageCache(pageSize, count)
+}
+
+func configPageCache(pageSize, count int) error {
+	if C._sqlite3_config_pagecache(C.int(pageSize), C.int(count)) != C.SQLITE_OK {
+		if allocConfig.pageCache == [2]int{pageSize, count} {
+			return nil
+		}
+		return errAlreadyInitialized
+	}
+	allocConfig.pageCache = [2]int{pageSize, count}
+	return nil
+}
+
+// parseAllocPair parses the "size,count" value of the DSN parameter name.
+func parseAllocPair(name, val string) (int, int, error) {
+	parts := strings.Split(val, ",")
+	if len(parts) == 2 {
+		size, err1 := strconv.ParseUint(parts[0], 10, 31)
+		count, err2 := strconv.ParseUint(parts[1], 10, 31)
+		if err1 == nil && err2 == nil {
+			return int(size), int(count), nil
+		}
+	}
+	return 0, 0, fmt.Errorf("Invalid %s: %v, expecting size,count", name, val)
+}
+
+// setLookaside replaces the lookaside allocator of a connection that has
+// not allocated from it yet.
+func setLookaside(db *C.sqlite3, size, count int) error {
+	if rv := C._sqlite3_db_config_lookaside(db, C.int(size), C.int(count)); rv != C.SQLITE_OK {
+		return lastError(db)
+	}
+	return nil
+}
@@ -0,0 +1,380 @@
+// Copyright (C) 2019 Yasuhiro Matsumoto <mattn.jp@gmail.com>.
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file.
+
+//go:build cgo
+// +build cgo
+
+package sqlite3
+
+/*
+#ifndef USE_LIBSQLITE3
+#include "sqlite3-binding.h"
+#else
+#include <sqlite3.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+	int op;
+	int table;
+	sqlite3_int64 rowid;
+} feed_change;
+
+// change_feed records the changes of the current transaction. It is only
+// touched by the hooks of its connection, and by Go once the transaction
+// has committed.
+typedef struct {
+	feed_change *changes;
+	int n, cap;
+	int overflow;
+	int abort_on_overflow;
+
+	// Set by the commit hook. The commit may still fail, in which case the
+	// rollback hook clears it, or return SQLITE_BUSY and be retried.
+	int committed;
+
+	// Interned "db\0table" names, indexed by feed_change.table.
+	char **tables;
+	int ntables, captables;
+	int last;
+} change_feed;
+
+static int feed_intern(change_feed *f, const char *db, const char *tab) {
+	int i;
+	size_t ldb, ltab;
+	char *name;
+	if (f->last < f->ntables) {
+		name = f->tables[f->last];
+		if (strcmp(name, db) == 0 && strcmp(name + strlen(name) + 1, tab) == 0) {
+			return f->last;
+		}
+	}
+	for (i = 0; i < f->ntables; i++) {
+		name = f->tables[i];
+		if (strcmp(name, db) == 0 && strcmp(name + strlen(name) + 1, tab) == 0) {
+			return f->last = i;
+		}
+	}
+	if (f->ntables == f->captables) {
+		int cap = f->captables ? 2 * f->captables : 8;
+		char **tables = realloc(f->tables, cap * sizeof(char*));
+		if (tables == NULL) {
+			return -1;
+		}
+		f->tables = tables;
+		f->captables = cap;
+	}
+	ldb = strlen(db);
+	ltab = strlen(tab);
+	name = malloc(ldb + ltab + 2);
+	if (name == NULL) {
+		return -1;
+	}
+	memcpy(name, db, ldb + 1);
+	memcpy(name + ldb + 1, tab, ltab + 1);
+	f->tables[f->ntables] = name;
+	return f->last = f->ntables++;
+}
+
+static void feed_update(void *p, int op, const char *db, const char *tab, sqlite3_int64 rowid) {
+	change_feed *f = p;
+	int table;
+	if (f->n == f->cap) {
+		f->overflow = 1;
+		return;
+	}
+	table = feed_intern(f, db, tab);
+	if (table < 0) {
+		f->overflow = 1;
+		return;
+	}
+	f->changes[f->n].op = op;
+	f->changes[f->n].table = table;
+	f->changes[f->n].rowid = rowid;
+	f->n++;
+}
+
+static int feed_commit(void *p) {
+	change_feed *f = p;
+	if (f->n == 0 && !f->overflow) {
+		return 0;
+	}
+	if (f->overflow && f->abort_on_overflow) {
+		// The rollback hook discards the changes.
+		return 1;
+	}
+	f->committed = 1;
+	return 0;
+}
+
+static void feed_rollback(void *p) {
+	change_feed *f = p;
+	f->n = 0;
+	f->overflow = 0;
+	f->committed = 0;
+}
+
+static change_feed *feed_open(int cap, int abort_on_overflow) {
+	change_feed *f = calloc(1, sizeof(change_feed));
+	if (f == NULL) {
+		return NULL;
+	}
+	f->changes = malloc(cap * sizeof(feed_change));
+	if (f->changes == NULL) {
+		free(f);
+		return NULL;
+	}
+	f->cap = cap;
+	f->abort_on_overflow = abort_on_overflow;
+	return f;
+}
+
+// feed_install sets the hooks of db to f and stores the previous arguments
+// of the update, commit and rollback hooks in prev.
+static void feed_install(sqlite3 *db, change_feed *f, void **prev) {
+	prev[0] = sqlite3_update_hook(db, feed_update, f);
+	prev[1] = sqlite3_commit_hook(db, feed_commit, f);
+	prev[2] = sqlite3_rollback_hook(db, feed_rollback, f);
+}
+
+static void feed_table(change_feed *f, int i, const char **db, const char **tab) {
+	*db = f->tables[i];
+	*tab = *db + strlen(*db) + 1;
+}
+
+static void feed_free(change_feed *f) {
+	int i;
+	for (i = 0; i < f->ntables; i++) {
+		free(f->tables[i]);
+	}
+	free(f->tables);
+	free(f->changes);
+	free(f);
+}
+*/
+import "C"
+import (
+	"errors"
+	"sync"
+	"sync/atomic"
+	"unsafe"
+)
+
+// defaultChangeFeedCapacity is the number of changes a transaction may
+// record when ChangeFeedOptions.Capacity is not positive.
+const defaultChangeFeedCapacity = 65536
+
+// defaultChangeFeedBuffer is the number of batches buffered when
+// ChangeFeedOptions.Buffer is not positive.
+const defaultChangeFeedBuffer = 64
+
+// Change is a row changed by a committed transaction.
+type Change struct {
+	Op    int   // SQLITE_INSERT, SQLITE_UPDATE or SQLITE_DELETE
+	Table int   // index of the table in ChangeBatch.Tables
+	RowID int64 // rowid of the row
+}
+
+// ChangeTable is a table of a change feed.
+type ChangeTable struct {
+	Database string // "main", "temp" or the name of an attached database
+	Name     string
+}
+
+// ChangeBatch holds the changes of a committed transaction.
+type ChangeBatch struct {
+	Changes []Change
+
+	// Tables lists the tables seen by the feed so far, in order of
+	// appearance. It is shared by the batches and must not be modified.
+	Tables []ChangeTable
+
+	// Truncated is set when the transaction changed more rows than the
+	// capacity of the feed; Changes then holds the first of them only.
+	Truncated bool
+
+	// Missed counts the batches dropped by ChangeFeedDrop since the
+	// previous batch was delivered.
+	Missed int
+}
+
+// ChangeFeedBackpressure selects what a commit does when the consumer of
+// a change feed has not taken the previous batches.
+type ChangeFeedBackpressure int
+
+const (
+	// ChangeFeedBlock makes the statement that committed wait for the
+	// consumer.
+	ChangeFeedBlock ChangeFeedBackpressure = iota
+	// ChangeFeedDrop drops the batch and counts it in the Missed field
+	// of the next one delivered.
+	ChangeFeedDrop
+)
+
+// ChangeFeedOptions configures a change feed.
+type ChangeFeedOptions struct {
+	// Capacity is the number of changes a transaction may record,
+	// 65536 if not positive.
+	Capacity int
+
+	// AbortOnOverflow makes a transaction changing more rows than
+	// Capacity fail with a constraint error, rather than deliver a
+	// Truncated batch.
+	AbortOnOverflow bool
+
+	// Buffer is the number of batches waiting for the consumer before
+	// Backpressure applies, 64 if not positive.
+	Buffer       int
+	Backpressure ChangeFeedBackpressure
+}
+
+// ChangeFeed delivers the rows changed by the transactions of a
+// connection, one batch per commit.
+type ChangeFeed struct {
+	// C delivers the batches. It is closed by Close.
+	C <-chan ChangeBatch
+
+	c      *SQLiteConn
+	f      *C.change_feed
+	ch     chan ChangeBatch
+	drop   bool
+	tables []ChangeTable
+	missed int
+
+	// mu is held while a batch is published, so that Close does not free
+	// the feed under a blocked publish.
+	mu        sync.Mutex
+	closeOnce sync.Once
+	done      chan struct{}
+}
+
+// ChangeFeed starts recording the rows changed by the connection. Changes
+// are kept in C memory until the transaction ends, with the table names
+// interned, and are delivered to Go as a single ChangeBatch once the
+// transaction has committed, when the statement that committed it returns.
+// They are discarded on rollback, including a COMMIT that fails. A batch
+// may hold changes that were rolled back to a savepoint.
+//
+// The feed installs the update, commit and rollback hooks of the
+// connection; RegisterUpdateHook, RegisterCommitHook and
+// RegisterRollbackHook close it. A connection has at most one feed.
+func (c *SQLiteConn) ChangeFeed(opts ChangeFeedOptions) (*ChangeFeed, error) {
+	if c.changeFeed != nil {
+		return nil, errors.New("the connection already has a change feed")
+	}
+	if opts.Capacity <= 0 {
+		opts.Capacity = defaultChangeFeedCapacity
+	}
+	if opts.Buffer <= 0 {
+		opts.Buffer = defaultChangeFeedBuffer
+	}
+	abort := 0
+	if opts.AbortOnOverflow {
+		abort = 1
+	}
+	f := C.feed_open(C.int(opts.Capacity), C.int(abort))
+	if f == nil {
+		return nil, ErrNomem
+	}
+	ch := make(chan ChangeBatch, opts.Buffer)
+	feed := &ChangeFeed{
+		C:    ch,
+		c:    c,
+		f:    f,
+		ch:   ch,
+		drop: opts.Backpressure == ChangeFeedDrop,
+		done: make(chan struct{}),
+	}
+
+	var prev [3]unsafe.Pointer
+	C.feed_install(c.db, f, &prev[0])
+	for _, p := range prev {
+		deleteHandle(c, p)
+	}
+	atomic.StorePointer(&c.changeFeed, unsafe.Pointer(feed))
+	return feed, nil
+}
+
+// publishChanges delivers the changes of the transaction the commit hook
+// let through, once it has committed. It is called after the statement
+// calls that may commit a transaction. The feed is loaded atomically as a
+// statement blocked in publish goes on once Close has unblocked it.
+func (c *SQLiteConn) publishChanges() {
+	feed := (*ChangeFeed)(atomic.LoadPointer(&c.changeFeed))
+	if feed != nil && feed.f.committed != 0 && C.sqlite3_get_autocommit(c.db) != 0 {
+		feed.publish()
+	}
+}
+
+// closeChangeFeed closes the change feed of the connection, if any.
+func (c *SQLiteConn) closeChangeFeed() {
+	if feed := (*ChangeFeed)(atomic.LoadPointer(&c.changeFeed)); feed != nil {
+		feed.Close()
+	}
+}
+
+// publish delivers the changes recorded by the committed transaction.
+func (feed *ChangeFeed) publish() {
+	feed.mu.Lock()
+	defer feed.mu.Unlock()
+	f := feed.f
+	for i := len(feed.tables); i < int(f.ntables); i++ {
+		var db, tab *C.char
+		C.feed_table(f, C.int(i), &db, &tab)
+		feed.tables = append(feed.tables, ChangeTable{Database: C.GoString(db), Name: C.GoString(tab)})
+	}
+	n := int(f.n)
+	b := ChangeBatch{
+		Changes:   make([]Change, n),
+		Tables:    feed.tables[:len(feed.tables):len(feed.tables)],
+		Truncated: f.overflow != 0,
+	}
+	if n > 0 {
+		changes := (*[(1 << 31) / C.sizeof_feed_change]C.feed_change)(unsafe.Pointer(f.changes))[:n:n]
+		for i, ch := range changes {
+			b.Changes[i] = Change{Op: int(ch.op), Table: int(ch.table), RowID: int64(ch.rowid)}
+		}
+	}
+	f.n = 0
+	f.overflow = 0
+	f.committed = 0
+
+	b.Missed = feed.missed
+	if feed.drop {
+		select {
+		case feed.ch <- b:
+			feed.missed = 0
+		default:
+			feed.missed++
+		}
+		return
+	}
+	select {
+	case feed.ch <- b:
+	case <-feed.done:
+	}
+}
+
+// Close stops the feed and closes C. A statement blocked on the consumer
+// returns without delivering its batch. Close must not otherwise run
+// concurrently with the statements of the connection.
+func (feed *ChangeFeed) Close() error {
+	feed.closeOnce.Do(func() {
+		c := feed.c
+		atomic.StorePointer(&c.changeFeed, nil)
+		close(feed.done)
+		feed.mu.Lock()
+		defer feed.mu.Unlock()
+		// Removing the hooks waits for running hooks, as SQLite holds the
+		// connection's mutex while they run.
+		C.sqlite3_update_hook(c.db, nil, nil)
+		C.sqlite3_commit_hook(c.db, nil, nil)
+		C.sqlite3_rollback_hook(c.db, nil, nil)
+		C.feed_free(feed.f)
+		close(feed.ch)
+	})
+	return nil
+}
@@ -0,0 +1,301 @@
+// Copyright (C) 2019 Yasuhiro Matsumoto <mattn.jp@gmail.com>.
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file.
+
+//go:build cgo
+// +build cgo
+
+package sqlite3
+
+import (
+	"database/sql/driver"
+	"os"
+	"reflect"
+	"testing"
+	"time"
+)
+
+func openChangeFeedConn(t testing.TB) *SQLiteConn {
+	d := SQLiteDriver{}
+	conn, err := d.Open(":memory:")
+	if err != nil {
+		t.Fatal("Failed to open database:", err)
+	}
+	c := conn.(*SQLiteConn)
+	for _, query := range []string{
+		"create table foo (id integer primary key, v text)",
+		"create table bar (id integer primary key, v text)",
+		"insert into bar values (7, 'x')",
+	} {
+		if _, err := c.Exec(query, nil); err != nil {
+			c.Close()
+			t.Fatal("Failed to create tables:", err)
+		}
+	}
+	return c
+}
+
+func mustExec(t testing.TB, c *SQLiteConn, queries ...string) {
+	for _, query := range queries {
+		if _, err := c.Exec(query, nil); err != nil {
+			t.Fatalf("%s: %v", query, err)
+		}
+	}
+}
+
+func TestChangeFeed(t *testing.T) {
+	c := openChangeFeedConn(t)
+	defer c.Close()
+	feed, err := c.ChangeFeed(ChangeFeedOptions{Buffer: 8})
+	if err != nil {
+		t.Fatal("Failed to start the change feed:", err)
+	}
+	if _, err := c.ChangeFeed(ChangeFeedOptions{}); err == nil {
+		t.Fatal("Expected an error starting a second change feed")
+	}
+
+	mustExec(t, c,
+		"begin",
+		"insert into foo values (1, 'a'), (2, 'b')",
+		"update bar set v = 'y'",
+		"delete from foo where id = 1",
+		"commit",
+	)
+	b := <-feed.C
+	want := []Change{
+		{SQLITE_INSERT, 0, 1},
+		{SQLITE_INSERT, 0, 2},
+		{SQLITE_UPDATE, 1, 7},
+		{SQLITE_DELETE, 0, 1},
+	}
+	if !reflect.DeepEqual(b.Changes, want) || b.Truncated || b.Missed != 0 {
+		t.Fatalf("unexpected batch %+v, want changes %v", b, want)
+	}
+	if tables := []ChangeTable{{"main", "foo"}, {"main", "bar"}}; !reflect.DeepEqual(b.Tables, tables) {
+		t.Fatalf("unexpected tables %v, want %v", b.Tables, tables)
+	}
+
+	// Rolled back and read-only transactions deliver nothing.
+	mustExec(t, c,
+		"begin",
+		"insert into foo values (3, 'c')",
+		"rollback",
+		"select * from foo",
+		"insert into bar values (8, 'z')",
+	)
+	b = <-feed.C
+	if want := []Change{{SQLITE_INSERT, 1, 8}}; !reflect.DeepEqual(b.Changes, want) {
+		t.Fatalf("unexpected changes %v, want %v", b.Changes, want)
+	}
+	select {
+	case b := <-feed.C:
+		t.Fatalf("unexpected batch %+v", b)
+	default:
+	}
+
+	// Replacing the hooks closes the feed.
+	c.RegisterUpdateHook(func(int, string, string, int64) {})
+	if _, ok := <-feed.C; ok {
+		t.Fatal("expected the feed to be closed")
+	}
+}
+
+func TestChangeFeedOverflow(t *testing.T) {
+	c := openChangeFeedConn(t)
+	defer c.Close()
+	feed, err := c.ChangeFeed(ChangeFeedOptions{Capacity: 2, Buffer: 1})
+	if err != nil {
+		t.Fatal("Failed to start the change feed:", err)
+	}
+	mustExec(t, c, "insert into foo values (1, 'a'), (2, 'b'), (3, 'c')")
+	b := <-feed.C
+	if !b.Truncated || len(b.Changes) != 2 {
+		t.Fatalf("expected 2 changes of a truncated batch, got %+v", b)
+	}
+	mustExec(t, c, "insert into foo values (4, 'd')")
+	if b = <-feed.C; b.Truncated || len(b.Changes) != 1 {
+		t.Fatalf("expected 1 change, got %+v", b)
+	}
+	feed.Close()
+
+	feed, err = c.ChangeFeed(ChangeFeedOptions{Capacity: 2, Buffer: 1, AbortOnOverflow: true})
+	if err != nil {
+		t.Fatal("Failed to start the change feed:", err)
+	}
+	defer feed.Close()
+	if _, err := c.Exec("insert into foo values (5, 'e'), (6, 'f'), (7, 'g')", nil); err == nil {
+		t.Fatal("expected the transaction to be aborted")
+	}
+	rows, err := c.Query("select count(*) from foo", nil)
+	if err != nil {
+		t.Fatal(err)
+	}
+	dest := make([]driver.Value, 1)
+	if err := rows.Next(dest); err != nil {
+		t.Fatal(err)
+	}
+	rows.Close()
+	if dest[0] != int64(4) {
+		t.Fatalf("expected 4 rows after the aborted insert, got %v", dest[0])
+	}
+	mustExec(t, c, "delete from foo where id = 1")
+	if b = <-feed.C; len(b.Changes) != 1 {
+		t.Fatalf("expected 1 change, got %+v", b)
+	}
+}
+
+func TestChangeFeedBackpressure(t *testing.T) {
+	c := openChangeFeedConn(t)
+	defer c.Close()
+	feed, err := c.ChangeFeed(ChangeFeedOptions{Buffer: 1, Backpressure: ChangeFeedDrop})
+	if err != nil {
+		t.Fatal("Failed to start the change feed:", err)
+	}
+	mustExec(t, c,
+		"insert into foo values (1, 'a')",
+		"insert into foo values (2, 'b')",
+		"insert into foo values (3, 'c')",
+	)
+	if b := <-feed.C; b.Missed != 0 || b.Changes[0].RowID != 1 {
+		t.Fatalf("expected the first batch, got %+v", b)
+	}
+	mustExec(t, c, "insert into foo values (4, 'd')")
+	if b := <-feed.C; b.Missed != 2 || b.Changes[0].RowID != 4 {
+		t.Fatalf("expected the last batch after 2 missed ones, got %+v", b)
+	}
+	feed.Close()
+
+	// The zero options buffer batches rather than block the committing
+	// goroutine.
+	feed, err = c.ChangeFeed(ChangeFeedOptions{})
+	if err != nil {
+		t.Fatal("Failed to start the change feed:", err)
+	}
+	mustExec(t, c, "delete from foo where id = 1", "delete from foo where id = 2")
+	if b := <-feed.C; b.Changes[0].RowID != 1 {
+		t.Fatalf("expected the first delete, got %+v", b)
+	}
+	if b := <-feed.C; b.Changes[0].RowID != 2 {
+		t.Fatalf("expected the second delete, got %+v", b)
+	}
+	feed.Close()
+
+	// A blocked commit returns when the feed is closed.
+	feed, err = c.ChangeFeed(ChangeFeedOptions{Buffer: 1})
+	if err != nil {
+		t.Fatal("Failed to start the change feed:", err)
+	}
+	mustExec(t, c, "delete from foo where id = 3")
+	done := make(chan error)
+	go func() {
+		_, err := c.Exec("insert into foo values (5, 'e')", nil)
+		done <- err
+	}()
+	select {
+	case err := <-done:
+		t.Fatal("expected the commit to block, got", err)
+	case <-time.After(50 * time.Millisecond):
+	}
+	feed.Close()
+	if err := <-done; err != nil {
+		t.Fatal(err)
+	}
+}
+
+func TestChangeFeedCommitFails(t *testing.T) {
+	tempFilename := TempFilename(t)
+	defer os.Remove(tempFilename)
+	d := SQLiteDriver{}
+	conn, err := d.Open(tempFilename + "?_busy_timeout=0")
+	if err != nil {
+		t.Fatal("Failed to open database:", err)
+	}
+	c := conn.(*SQLiteConn)
+	defer c.Close()
+	mustExec(t, c, "create table foo (id integer primary key)")
+	conn, err = d.Open(tempFilename + "?_busy_timeout=0")
+	if err != nil {
+		t.Fatal("Failed to open database:", err)
+	}
+	reader := conn.(*SQLiteConn)
+	defer reader.Close()
+
+	feed, err := c.ChangeFeed(ChangeFeedOptions{})
+	if err != nil {
+		t.Fatal("Failed to start the change feed:", err)
+	}
+	defer feed.Close()
+
+	// The shared lock of the reader makes the COMMIT fail with
+	// SQLITE_BUSY after the commit hook has run.
+	mustExec(t, reader, "begin")
+	rows, err := reader.Query("select count(*) from foo", nil)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if err := rows.Next(make([]driver.Value, 1)); err != nil {
+		t.Fatal(err)
+	}
+	rows.Close()
+	mustExec(t, c, "begin", "insert into foo values (1)")
+	if _, err := c.Exec("commit", nil); err == nil {
+		t.Fatal("expected the commit to fail")
+	}
+	select {
+	case b := <-feed.C:
+		t.Fatalf("unexpected batch %+v of a failed commit", b)
+	default:
+	}
+
+	// The retried COMMIT delivers the batch once.
+	mustExec(t, reader, "rollback")
+	mustExec(t, c, "commit")
+	if b := <-feed.C; len(b.Changes) != 1 || b.Changes[0].RowID != 1 {
+		t.Fatalf("expected the insert, got %+v", b)
+	}
+	select {
+	case b := <-feed.C:
+		t.Fatalf("unexpected batch %+v", b)
+	default:
+	}
+}
+
+// BenchmarkChangeFeed updates 100k rows in one transaction, observed by an
+// update hook or by a change feed.
+func BenchmarkChangeFeed(b *testing.B) {
+	const rows = 100000
+	c := openChangeFeedConn(b)
+	defer c.Close()
+	mustExec(b, c, "insert into foo WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 100000) SELECT i, 'x' FROM n")
+
+	b.Run("updatehook", func(b *testing.B) {
+		var changed []int64
+		c.RegisterUpdateHook(func(op int, db, table string, rowid int64) {
+			changed = append(changed, rowid)
+		})
+		defer c.RegisterUpdateHook(nil)
+		b.ReportAllocs()
+		for i := 0; i < b.N; i++ {
+			changed = changed[:0]
+			mustExec(b, c, "update foo set v = 'y'")
+			if len(changed) != rows {
+				b.Fatalf("want %d changes, got %d", rows, len(changed))
+			}
+		}
+	})
+	b.Run("feed", func(b *testing.B) {
+		feed, err := c.ChangeFeed(ChangeFeedOptions{Capacity: rows, Buffer: 1})
+		if err != nil {
+			b.Fatal(err)
+		}
+		defer feed.Close()
+		b.ReportAllocs()
+		for i := 0; i < b.N; i++ {
+			mustExec(b, c, "update foo set v = 'y'")
+			if batch := <-feed.C; len(batch.Changes) != rows {
+				b.Fatalf("want %d changes, got %d", rows, len(batch.Changes))
+			}
+		}
+	})
+}
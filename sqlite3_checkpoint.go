@@ -0,0 +1,311 @@
+// Copyright (C) 2019 Yasuhiro Matsumoto <mattn.jp@gmail.com>.
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file.
+
+//go:build cgo
+// +build cgo
+
+package sqlite3
+
+/*
+#ifndef USE_LIBSQLITE3
+#include "sqlite3-binding.h"
+#else
+#include <sqlite3.h>
+#endif
+
+int walHookTrampoline(void*, sqlite3*, char*, int);
+*/
+import "C"
+import (
+	"fmt"
+	"net/url"
+	"strconv"
+	"sync"
+	"sync/atomic"
+	"time"
+	"unsafe"
+)
+
+// CheckpointStats reports the activity of the background WAL checkpointer
+// of a database file, enabled with the _bg_checkpoint DSN parameter.
+type CheckpointStats struct {
+	Checkpoints   uint64        // checkpoints run
+	Restarts      uint64        // checkpoints escalated to RESTART
+	Truncates     uint64        // checkpoints escalated to TRUNCATE
+	Busy          uint64        // checkpoints that could not complete
+	Frames        uint64        // frames copied back into the database
+	WALFrames     int64         // frames in the WAL after the last commit or checkpoint
+	LastDuration  time.Duration // duration of the last checkpoint
+	MaxDuration   time.Duration // longest checkpoint
+	TotalDuration time.Duration // time spent checkpointing
+
+	// OpenErrors counts the failures to open the checkpointer's connection
+	// and Err holds the last of them, until the connection is opened.
+	// Meanwhile the committing connections checkpoint inline, as the
+	// automatic checkpoint does.
+	OpenErrors uint64
+	Err        error
+}
+
+// checkpointBusyTimeout is the busy timeout in milliseconds of the
+// checkpointer's connection. RESTART and TRUNCATE hold the write lock while
+// they wait for readers, so they must give up quickly.
+const checkpointBusyTimeout = 100
+
+// Delays between the attempts to open the checkpointer's connection.
+const (
+	checkpointMinBackoff = 10 * time.Millisecond
+	checkpointMaxBackoff = time.Second
+)
+
+// checkpointers holds the background checkpointers by database file name.
+var checkpointers = struct {
+	sync.Mutex
+	m map[string]*checkpointer
+}{m: map[string]*checkpointer{}}
+
+// checkpointer takes WAL checkpoints off the committing connections. The
+// connections sharing a database file install a WAL hook that wakes it up
+// once the WAL holds threshold frames; it then checkpoints on its own
+// connection, escalating from PASSIVE to RESTART when readers keep it from
+// catching up or the WAL keeps growing, and to TRUNCATE when the WAL has
+// grown far past threshold.
+type checkpointer struct {
+	filename  string
+	dsn       string // of the checkpointer's connection
+	threshold int
+	refs      int // guarded by checkpointers
+
+	walFrames  int64 // atomic; frames in the WAL
+	backfilled int64 // atomic; frames of the WAL already checkpointed
+	inline     int32 // atomic; set while the connection cannot be opened
+	wake       chan struct{}
+	stop       chan struct{}
+	done       chan struct{}
+
+	mu    sync.Mutex
+	stats CheckpointStats
+}
+
+// checkpointerDSN derives the DSN of the checkpointer's connection from the
+// file name and parameters of the connection starting it, so that it uses
+// the same URI, VFS and connection options. The options that would start
+// another checkpointer or that apply to the whole process are left out,
+// and the busy timeout is checkpointBusyTimeout.
+func checkpointerDSN(name string, params url.Values) string {
+	q := url.Values{}
+	for key, vals := range params {
+		switch key {
+		case "_bg_checkpoint", "_busy_timeout", "_timeout", "_query_only",
+			"_soft_heap_limit", "_hard_heap_limit", "_pagecache":
+			continue
+		}
+		q[key] = vals
+	}
+	q.Set("_busy_timeout", strconv.Itoa(checkpointBusyTimeout))
+	return name + "?" + q.Encode()
+}
+
+// acquireCheckpointer returns the checkpointer of filename, starting it if
+// this is the first connection to ask for one. The connections sharing a
+// checkpointer must ask for the same threshold.
+func acquireCheckpointer(filename, dsn string, threshold int) (*checkpointer, error) {
+	checkpointers.Lock()
+	defer checkpointers.Unlock()
+	cp := checkpointers.m[filename]
+	if cp != nil && cp.threshold != threshold {
+		return nil, fmt.Errorf("_bg_checkpoint=%d conflicts with the checkpointer of %s, started with %d", threshold, filename, cp.threshold)
+	}
+	if cp == nil {
+		cp = &checkpointer{
+			filename:  filename,
+			dsn:       dsn,
+			threshold: threshold,
+			wake:      make(chan struct{}, 1),
+			stop:      make(chan struct{}),
+			done:      make(chan struct{}),
+		}
+		checkpointers.m[filename] = cp
+		go cp.run()
+	}
+	cp.refs++
+	return cp, nil
+}
+
+// release stops the checkpointer with the last connection using it.
+func (cp *checkpointer) release() {
+	checkpointers.Lock()
+	cp.refs--
+	last := cp.refs == 0
+	if last {
+		delete(checkpointers.m, cp.filename)
+	}
+	checkpointers.Unlock()
+	if last {
+		close(cp.stop)
+		<-cp.done
+	}
+}
+
+// install makes c report its commits to cp instead of checkpointing inline.
+func (cp *checkpointer) install(c *SQLiteConn) {
+	C.sqlite3_wal_hook(c.db, (*[0]byte)(C.walHookTrampoline), newHandle(c, cp))
+}
+
+// committed is called by the WAL hook after every commit. It reports
+// whether the committing connection has to checkpoint inline, because the
+// checkpointer's connection could not be opened.
+func (cp *checkpointer) committed(frames int) bool {
+	atomic.StoreInt64(&cp.walFrames, int64(frames))
+	if atomic.LoadInt32(&cp.inline) != 0 {
+		return frames >= cp.threshold
+	}
+	if cp.pending() >= int64(cp.threshold) {
+		select {
+		case cp.wake <- struct{}{}:
+		default:
+		}
+	}
+	return false
+}
+
+// pending returns the number of frames left to checkpoint. A WAL smaller
+// than what was checkpointed has been restarted by a writer.
+func (cp *checkpointer) pending() int64 {
+	frames, backfilled := atomic.LoadInt64(&cp.walFrames), atomic.LoadInt64(&cp.backfilled)
+	if frames < backfilled {
+		return frames
+	}
+	return frames - backfilled
+}
+
+func (cp *checkpointer) run() {
+	defer close(cp.done)
+	var c *SQLiteConn
+	defer func() {
+		if c != nil {
+			c.Close()
+		}
+	}()
+	behind := 0
+	backoff := checkpointMinBackoff
+	for {
+		select {
+		case <-cp.wake:
+		case <-cp.stop:
+			return
+		}
+		for c == nil {
+			dc, err := (&SQLiteDriver{}).Open(cp.dsn)
+			if err == nil {
+				c = dc.(*SQLiteConn)
+				cp.mu.Lock()
+				cp.stats.Err = nil
+				cp.mu.Unlock()
+				atomic.StoreInt32(&cp.inline, 0)
+				break
+			}
+			cp.mu.Lock()
+			cp.stats.OpenErrors++
+			cp.stats.Err = err
+			cp.mu.Unlock()
+			atomic.StoreInt32(&cp.inline, 1)
+			select {
+			case <-time.After(backoff):
+			case <-cp.stop:
+				return
+			}
+			if backoff *= 2; backoff > checkpointMaxBackoff {
+				backoff = checkpointMaxBackoff
+			}
+		}
+
+		// PASSIVE checkpoints may keep up while a busy writer never lets
+		// the WAL restart, so escalate on its size too.
+		mode, frames, size := C.SQLITE_CHECKPOINT_PASSIVE, cp.pending(), atomic.LoadInt64(&cp.walFrames)
+		switch {
+		case size >= 16*int64(cp.threshold):
+			mode = C.SQLITE_CHECKPOINT_TRUNCATE
+		case size >= 4*int64(cp.threshold), behind >= 2:
+			mode = C.SQLITE_CHECKPOINT_RESTART
+		}
+		var nLog, nCkpt C.int
+		start := time.Now()
+		rv := C.sqlite3_wal_checkpoint_v2(c.db, nil, C.int(mode), &nLog, &nCkpt)
+		elapsed := time.Since(start)
+
+		complete := rv == C.SQLITE_OK && nCkpt == nLog
+		if complete {
+			behind = 0
+		} else {
+			behind++
+		}
+		var copied int64
+		if rv == C.SQLITE_OK {
+			// nCkpt counts every frame checkpointed since the WAL was last
+			// restarted, and both counts are zero after a TRUNCATE.
+			if mode == C.SQLITE_CHECKPOINT_TRUNCATE {
+				copied = frames
+			} else if prev := atomic.LoadInt64(&cp.backfilled); int64(nCkpt) >= prev {
+				copied = int64(nCkpt) - prev
+			} else {
+				copied = int64(nCkpt)
+			}
+			atomic.StoreInt64(&cp.walFrames, int64(nLog))
+			atomic.StoreInt64(&cp.backfilled, int64(nCkpt))
+		}
+
+		cp.mu.Lock()
+		s := &cp.stats
+		s.Checkpoints++
+		switch mode {
+		case C.SQLITE_CHECKPOINT_RESTART:
+			s.Restarts++
+		case C.SQLITE_CHECKPOINT_TRUNCATE:
+			s.Truncates++
+		}
+		if !complete {
+			s.Busy++
+		}
+		s.Frames += uint64(copied)
+		s.LastDuration = elapsed
+		if elapsed > s.MaxDuration {
+			s.MaxDuration = elapsed
+		}
+		s.TotalDuration += elapsed
+		cp.mu.Unlock()
+
+		if !complete && cp.pending() >= int64(cp.threshold) {
+			// Try again on the next commit, or after a pause if there is none.
+			select {
+			case <-time.After(10 * time.Millisecond):
+				cp.committed(int(atomic.LoadInt64(&cp.walFrames)))
+			case <-cp.stop:
+				return
+			}
+		}
+	}
+}
+
+// CheckpointStats returns the counters of the background checkpointer of
+// the connection's main database. The zero value is returned when
+// _bg_checkpoint is not enabled.
+func (c *SQLiteConn) CheckpointStats() CheckpointStats {
+	cp := c.checkpointer
+	if cp == nil {
+		return CheckpointStats{}
+	}
+	cp.mu.Lock()
+	s := cp.stats
+	cp.mu.Unlock()
+	s.WALFrames = atomic.LoadInt64(&cp.walFrames)
+	return s
+}
+
+// isMainDB reports whether the schema name passed to a hook is "main".
+func isMainDB(name *C.char) bool {
+	b := (*[5]byte)(unsafe.Pointer(name))
+	return b[0] == 'm' && b[1] == 'a' && b[2] == 'i' && b[3] == 'n' && b[4] == 0
+}
@@ -0,0 +1,313 @@
+// Copyright (C) 2019 Yasuhiro Matsumoto <mattn.jp@gmail.com>.
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file.
+
+//go:build cgo
+// +build cgo
+
+package sqlite3
+
+/*
+#ifndef USE_LIBSQLITE3
+#include "sqlite3-binding.h"
+#else
+#include <sqlite3.h>
+#endif
+*/
+import "C"
+import (
+	"context"
+	"database/sql/driver"
+	"fmt"
+	"math"
+	"strings"
+	"unsafe"
+)
+
+// ColumnKind is the type of the values in a ColumnVector.
+type ColumnKind int
+
+// Column kinds. A column without a declared type or with NUMERIC affinity
+// takes the kind of its non-NULL values; it is ColumnNull until one has been
+// seen.
+const (
+	ColumnInt64   ColumnKind = C.SQLITE_INTEGER
+	ColumnFloat64 ColumnKind = C.SQLITE_FLOAT
+	ColumnText    ColumnKind = C.SQLITE_TEXT
+	ColumnBlob    ColumnKind = C.SQLITE_BLOB
+	ColumnNull    ColumnKind = C.SQLITE_NULL
+)
+
+func (k ColumnKind) String() string {
+	switch k {
+	case ColumnInt64:
+		return "integer"
+	case ColumnFloat64:
+		return "real"
+	case ColumnText:
+		return "text"
+	case ColumnBlob:
+		return "blob"
+	case ColumnNull:
+		return "null"
+	}
+	return fmt.Sprintf("ColumnKind(%d)", int(k))
+}
+
+// defaultChunkSize is used by QueryColumns when chunkSize is not positive.
+const defaultChunkSize = 1024
+
+// ColumnVector holds the values of one result column for the rows of a
+// ColumnChunk. Only the slice matching Kind is filled. NULL values are
+// stored as the zero value and flagged in Nulls.
+type ColumnVector struct {
+	Name string
+	Kind ColumnKind
+
+	Int64   []int64   // ColumnInt64
+	Float64 []float64 // ColumnFloat64
+	Text    []string  // ColumnText
+
+	// For ColumnText and ColumnBlob, value i is Data[Offsets[i]:Offsets[i+1]].
+	Data    []byte
+	Offsets []int
+
+	// Nulls is a bitmap with bit i%64 of word i/64 set when value i is NULL.
+	Nulls []uint64
+}
+
+// IsNull reports whether value i of the vector is NULL.
+func (v *ColumnVector) IsNull(i int) bool {
+	return v.Nulls[i/64]&(1<<(uint(i)%64)) != 0
+}
+
+// Bytes returns value i of a ColumnText or ColumnBlob vector.
+func (v *ColumnVector) Bytes(i int) []byte {
+	return v.Data[v.Offsets[i]:v.Offsets[i+1]:v.Offsets[i+1]]
+}
+
+// ColumnChunk is a block of consecutive result rows stored column by column.
+type ColumnChunk struct {
+	Len     int // number of rows
+	Columns []ColumnVector
+}
+
+// QueryColumns runs query and calls fn with chunks of up to chunkSize rows.
+// Rows are stepped and packed in C and decoded straight into typed vectors,
+// so no driver.Value is allocated per cell.
+//
+// Column kinds follow the declared type affinity: INTEGER and BOOLEAN
+// columns are ColumnInt64, REAL ones ColumnFloat64, text ones ColumnText and
+// BLOB ones ColumnBlob. Date and time columns are ColumnText, or the numeric
+// kind stored by _time_format, and their values are converted by SQLite to
+// the kind of their column. Other columns, NUMERIC ones and expressions,
+// take the kind of their values. Such a column holding both integers and
+// reals is ColumnFloat64 from the chunk where the first real shows up, and
+// QueryColumns fails if it holds values of any other mix of kinds.
+//
+// The chunk and its vectors are reused; only Text strings may be retained
+// after fn returns. An error returned by fn stops the query and is returned.
+func (c *SQLiteConn) QueryColumns(query string, args []driver.Value, chunkSize int, fn func(*ColumnChunk) error) error {
+	list := make([]driver.NamedValue, len(args))
+	for i, v := range args {
+		list[i] = driver.NamedValue{
+			Ordinal: i + 1,
+			Value:   v,
+		}
+	}
+	return c.QueryColumnsContext(context.Background(), query, list, chunkSize, fn)
+}
+
+// QueryColumnsContext is like QueryColumns, and interrupts the query when
+// ctx is done.
+func (c *SQLiteConn) QueryColumnsContext(ctx context.Context, query string, args []driver.NamedValue, chunkSize int, fn func(*ColumnChunk) error) error {
+	rows, err := c.query(ctx, query, args)
+	if err != nil {
+		return err
+	}
+	rc := rows.(*SQLiteRows)
+	defer rc.Close()
+	return rc.scanColumns(chunkSize, fn)
+}
+
+// columnKind maps a lower case declared type to a kind following the
+// affinity rules of SQLite. It returns 0 when the kind has to be taken from
+// the values: for NUMERIC affinity, which keeps both integers and reals, and
+// for an empty declared type, which is also that of expressions.
+func columnKind(decltype string, tf timeFormat) C.int {
+	isTime := strings.Contains(decltype, "date") || strings.Contains(decltype, "time")
+	switch {
+	case decltype == "":
+		return 0
+	case isTime && (tf == timeFormatUnixNano || tf == timeFormatUnixMilli):
+		return C.SQLITE_INTEGER
+	case isTime && tf == timeFormatJulianDay:
+		return C.SQLITE_FLOAT
+	case strings.Contains(decltype, "int"), decltype == "boolean":
+		return C.SQLITE_INTEGER
+	case strings.Contains(decltype, "char"), strings.Contains(decltype, "clob"), strings.Contains(decltype, "text"):
+		return C.SQLITE_TEXT
+	case strings.Contains(decltype, "blob"):
+		return C.SQLITE_BLOB
+	case strings.Contains(decltype, "real"), strings.Contains(decltype, "floa"), strings.Contains(decltype, "doub"):
+		return C.SQLITE_FLOAT
+	case isTime:
+		return C.SQLITE_TEXT
+	default:
+		return 0
+	}
+}
+
+func (rc *SQLiteRows) scanColumns(chunkSize int, fn func(*ColumnChunk) error) error {
+	if chunkSize <= 0 {
+		chunkSize = defaultChunkSize
+	}
+	names := rc.Columns()
+
+	rc.s.mu.Lock()
+	defer rc.s.mu.Unlock()
+	kinds := make([]C.int, rc.nc)
+	for i, t := range rc.declTypes() {
+		kinds[i] = columnKind(t, rc.s.c.timeFormat)
+	}
+	chunk := &ColumnChunk{Columns: make([]ColumnVector, rc.nc)}
+	for i := range chunk.Columns {
+		chunk.Columns[i].Name = names[i]
+		chunk.Columns[i].Kind = ColumnNull
+	}
+
+	for {
+		if rc.s.closed || rc.closed {
+			return nil
+		}
+		if rc.done != nil {
+			select {
+			case <-rc.done:
+				return rc.ctx.Err()
+			default:
+			}
+		}
+		n, rv := rc.s.batch.step(rc.s, rc.nc, chunkSize, math.MaxInt32, kinds)
+		if n > 0 {
+			if err := chunk.decode(rc.s.batch.bytes(), n, kinds); err != nil {
+				C.sqlite3_reset(rc.s.s)
+				return err
+			}
+			rc.s.mu.Unlock()
+			err := fn(chunk)
+			rc.s.mu.Lock()
+			if err != nil {
+				return err
+			}
+		}
+		switch rv {
+		case C.SQLITE_ROW:
+		case C.SQLITE_DONE:
+			return nil
+		case C.SQLITE_NOMEM:
+			return ErrNomem
+		default:
+			err := rc.s.c.lastError()
+			C.sqlite3_reset(rc.s.s)
+			if isInterruptErr(err) && rc.ctx.Err() != nil {
+				return rc.ctx.Err()
+			}
+			return err
+		}
+	}
+}
+
+// valueKinds sets the kind of the columns with a zero kind from the types
+// of their n rows of packed cells, on top of the kind of the previous chunk.
+// Integers and reals make a ColumnFloat64 column; other mixes are an error.
+func (ch *ColumnChunk) valueKinds(buf []byte, n int, kinds []C.int) error {
+	off := 0
+	for r := 0; r < n; r++ {
+		for i := range ch.Columns {
+			c := (*cell)(unsafe.Pointer(&buf[off]))
+			off += cellSize + (int(c.n)+7)&^7
+			v := &ch.Columns[i]
+			k := ColumnKind(c.typ)
+			if kinds[i] != 0 || k == ColumnNull || k == v.Kind {
+				continue
+			}
+			switch {
+			case v.Kind == ColumnNull:
+				v.Kind = k
+			case v.Kind == ColumnInt64 && k == ColumnFloat64:
+				v.Kind = ColumnFloat64
+			case v.Kind == ColumnFloat64 && k == ColumnInt64:
+			default:
+				return fmt.Errorf("sqlite3: column %s mixes %s and %s values", v.Name, v.Kind, k)
+			}
+		}
+	}
+	return nil
+}
+
+// decode fills the vectors from n rows of packed cells.
+func (ch *ColumnChunk) decode(buf []byte, n int, kinds []C.int) error {
+	if err := ch.valueKinds(buf, n, kinds); err != nil {
+		return err
+	}
+	ch.Len = n
+	words := (n + 63) / 64
+	for i := range ch.Columns {
+		v := &ch.Columns[i]
+		if kinds[i] != 0 {
+			v.Kind = ColumnKind(kinds[i])
+		}
+		v.Int64 = v.Int64[:0]
+		v.Float64 = v.Float64[:0]
+		v.Text = v.Text[:0]
+		v.Data = v.Data[:0]
+		v.Offsets = append(v.Offsets[:0], 0)
+		if cap(v.Nulls) < words {
+			v.Nulls = make([]uint64, words)
+		}
+		v.Nulls = v.Nulls[:words]
+		for j := range v.Nulls {
+			v.Nulls[j] = 0
+		}
+	}
+
+	off := 0
+	for r := 0; r < n; r++ {
+		for i := range ch.Columns {
+			v := &ch.Columns[i]
+			c := (*cell)(unsafe.Pointer(&buf[off]))
+			off += cellSize
+			if c.typ == C.SQLITE_NULL {
+				v.Nulls[r/64] |= 1 << (uint(r) % 64)
+			}
+			switch v.Kind {
+			case ColumnInt64:
+				v.Int64 = append(v.Int64, int64(c.v))
+			case ColumnFloat64:
+				if c.typ == C.SQLITE_INTEGER {
+					v.Float64 = append(v.Float64, float64(int64(c.v)))
+				} else {
+					v.Float64 = append(v.Float64, *(*float64)(unsafe.Pointer(&c.v)))
+				}
+			case ColumnText, ColumnBlob:
+				v.Data = append(v.Data, buf[off:off+int(c.n)]...)
+				v.Offsets = append(v.Offsets, len(v.Data))
+			}
+			off += (int(c.n) + 7) &^ 7
+		}
+	}
+
+	// One string per text column and chunk backs all of its values.
+	for i := range ch.Columns {
+		v := &ch.Columns[i]
+		if v.Kind != ColumnText {
+			continue
+		}
+		s := string(v.Data)
+		for r := 0; r < n; r++ {
+			v.Text = append(v.Text, s[v.Offsets[r]:v.Offsets[r+1]])
+		}
+	}
+	return nil
+}
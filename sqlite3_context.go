@@ -16,13 +16,57 @@ package sqlite3
 // These wrappers are necessary because SQLITE_TRANSIENT
 // is a pointer constant, and cgo doesn't translate them correctly.
 
-static inline void my_result_text(sqlite3_context *ctx, char *p, int np) {
+static inline void my_result_text(void *ctx, char *p, int np) {
 	sqlite3_result_text(ctx, p, np, SQLITE_TRANSIENT);
 }
 
-static inline void my_result_blob(sqlite3_context *ctx, void *p, int np) {
+static inline void my_result_blob(void *ctx, void *p, int np) {
 	sqlite3_result_blob(ctx, p, np, SQLITE_TRANSIENT);
 }
+
+// The functions called for every row take the sqlite3_context and
+// sqlite3_value pointers as void*: cgo allocates to check pointers to
+// incomplete C types passed to C, but not unsafe.Pointer.
+
+static inline void my_result_int(void *ctx, int i) {
+	sqlite3_result_int(ctx, i);
+}
+
+static inline void my_result_int64(void *ctx, sqlite3_int64 i) {
+	sqlite3_result_int64(ctx, i);
+}
+
+static inline void my_result_double(void *ctx, double d) {
+	sqlite3_result_double(ctx, d);
+}
+
+static inline void my_result_null(void *ctx) {
+	sqlite3_result_null(ctx);
+}
+
+static inline int my_value_type(void *v) {
+	return sqlite3_value_type(v);
+}
+
+static inline sqlite3_int64 my_value_int64(void *v) {
+	return sqlite3_value_int64(v);
+}
+
+static inline double my_value_double(void *v) {
+	return sqlite3_value_double(v);
+}
+
+static inline const void *my_value_text(void *v, int *n) {
+	const void *p = sqlite3_value_text(v);
+	*n = sqlite3_value_bytes(v);
+	return p;
+}
+
+static inline const void *my_value_blob(void *v, int *n) {
+	const void *p = sqlite3_value_blob(v);
+	*n = sqlite3_value_bytes(v);
+	return p;
+}
 */
 import "C"
 
@@ -57,35 +101,35 @@ func (c *SQLiteContext) ResultBlob(b []byte) {
 	if len(b) > 0 {
 		p = &b[0]
 	}
-	C.my_result_blob((*C.sqlite3_context)(c), unsafe.Pointer(p), C.int(len(b)))
+	C.my_result_blob(unsafe.Pointer(c), unsafe.Pointer(p), C.int(len(b)))
 }
 
 // ResultDouble sets the result of an SQL function.
 // See: sqlite3_result_double, http://sqlite.org/c3ref/result_blob.html
 func (c *SQLiteContext) ResultDouble(d float64) {
-	C.sqlite3_result_double((*C.sqlite3_context)(c), C.double(d))
+	C.my_result_double(unsafe.Pointer(c), C.double(d))
 }
 
 // ResultInt sets the result of an SQL function.
 // See: sqlite3_result_int, http://sqlite.org/c3ref/result_blob.html
 func (c *SQLiteContext) ResultInt(i int) {
 	if i64 && (i > math.MaxInt32 || i < math.MinInt32) {
-		C.sqlite3_result_int64((*C.sqlite3_context)(c), C.sqlite3_int64(i))
+		C.my_result_int64(unsafe.Pointer(c), C.sqlite3_int64(i))
 	} else {
-		C.sqlite3_result_int((*C.sqlite3_context)(c), C.int(i))
+		C.my_result_int(unsafe.Pointer(c), C.int(i))
 	}
 }
 
 // ResultInt64 sets the result of an SQL function.
 // See: sqlite3_result_int64, http://sqlite.org/c3ref/result_blob.html
 func (c *SQLiteContext) ResultInt64(i int64) {
-	C.sqlite3_result_int64((*C.sqlite3_context)(c), C.sqlite3_int64(i))
+	C.my_result_int64(unsafe.Pointer(c), C.sqlite3_int64(i))
 }
 
 // ResultNull sets the result of an SQL function.
 // See: sqlite3_result_null, http://sqlite.org/c3ref/result_blob.html
 func (c *SQLiteContext) ResultNull() {
-	C.sqlite3_result_null((*C.sqlite3_context)(c))
+	C.my_result_null(unsafe.Pointer(c))
 }
 
 // ResultText sets the result of an SQL function.
@@ -93,7 +137,7 @@ func (c *SQLiteContext) ResultNull() {
 func (c *SQLiteContext) ResultText(s string) {
 	h := (*reflect.StringHeader)(unsafe.Pointer(&s))
 	cs, l := (*C.char)(unsafe.Pointer(h.Data)), C.int(h.Len)
-	C.my_result_text((*C.sqlite3_context)(c), cs, l)
+	C.my_result_text(unsafe.Pointer(c), cs, l)
 }
 
 // ResultZeroblob sets the result of an SQL function.
@@ -101,3 +145,52 @@ func (c *SQLiteContext) ResultText(s string) {
 func (c *SQLiteContext) ResultZeroblob(n int) {
 	C.sqlite3_result_zeroblob((*C.sqlite3_context)(c), C.int(n))
 }
+
+// ResultError makes the SQL function fail with the message of err.
+// See: sqlite3_result_error, http://sqlite.org/c3ref/result_blob.html
+func (c *SQLiteContext) ResultError(err error) {
+	callbackError((*C.sqlite3_context)(c), err)
+}
+
+// SQLiteValue behave sqlite3_value. It is an argument of a function
+// registered with RegisterFuncRaw, only valid until the function returns.
+type SQLiteValue C.sqlite3_value
+
+// Kind returns the storage class of the value.
+// See: sqlite3_value_type, http://sqlite.org/c3ref/value_blob.html
+func (v *SQLiteValue) Kind() ColumnKind {
+	return ColumnKind(C.my_value_type(unsafe.Pointer(v)))
+}
+
+// IsNull reports whether the value is NULL.
+func (v *SQLiteValue) IsNull() bool {
+	return C.my_value_type(unsafe.Pointer(v)) == C.SQLITE_NULL
+}
+
+// Int64 returns the value converted to an integer.
+// See: sqlite3_value_int64, http://sqlite.org/c3ref/value_blob.html
+func (v *SQLiteValue) Int64() int64 {
+	return int64(C.my_value_int64(unsafe.Pointer(v)))
+}
+
+// Float64 returns the value converted to a floating point number.
+// See: sqlite3_value_double, http://sqlite.org/c3ref/value_blob.html
+func (v *SQLiteValue) Float64() float64 {
+	return float64(C.my_value_double(unsafe.Pointer(v)))
+}
+
+// Text returns the value converted to text.
+// See: sqlite3_value_text, http://sqlite.org/c3ref/value_blob.html
+func (v *SQLiteValue) Text() string {
+	var n C.int
+	p := C.my_value_text(unsafe.Pointer(v), &n)
+	return C.GoStringN((*C.char)(p), n)
+}
+
+// Blob returns a copy of the value converted to a BLOB.
+// See: sqlite3_value_blob, http://sqlite.org/c3ref/value_blob.html
+func (v *SQLiteValue) Blob() []byte {
+	var n C.int
+	p := C.my_value_blob(unsafe.Pointer(v), &n)
+	return C.GoBytes(p, n)
+}
@@ -0,0 +1,79 @@
+// Copyright (C) 2019 Yasuhiro Matsumoto <mattn.jp@gmail.com>.
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file.
+
+//go:build cgo
+// +build cgo
+
+package sqlite3
+
+/*
+#ifndef USE_LIBSQLITE3
+#include "sqlite3-binding.h"
+#else
+#include <sqlite3.h>
+#endif
+#include <stdlib.h>
+*/
+import "C"
+import (
+	"errors"
+	"unsafe"
+)
+
+// QueryPlanRow is a row of the EXPLAIN QUERY PLAN output of a statement.
+// Rows form a tree through Parent, which is 0 for top level rows.
+type QueryPlanRow struct {
+	ID     int
+	Parent int
+	Detail string
+}
+
+// ScanStatus describes a loop of a statement as reported by
+// sqlite3_stmt_scanstatus, accumulated since it was prepared or reset.
+type ScanStatus struct {
+	SelectID  int     // EXPLAIN QUERY PLAN id of the loop
+	ParentID  int     // id of the parent row, 0 when unknown
+	Name      string  // table or index scanned, empty for other steps
+	Explain   string  // EXPLAIN QUERY PLAN detail of the loop
+	Loops     int64   // times the loop was run
+	Visits    int64   // rows visited by the loop
+	Estimated float64 // rows per loop estimated by the query planner
+	Cycles    int64   // CPU cycles spent in the loop, -1 when not available
+}
+
+// QueryPlan returns the EXPLAIN QUERY PLAN output of the statement. The
+// plan is computed for unbound parameters, so it may differ from the one
+// used with specific values when those enable STAT4 or LIKE optimizations.
+func (s *SQLiteStmt) QueryPlan() ([]QueryPlanRow, error) {
+	s.mu.Lock()
+	defer s.mu.Unlock()
+	if s.closed || s.s == nil {
+		return nil, errors.New("sqlite statement is closed")
+	}
+
+	query := C.CString("EXPLAIN QUERY PLAN " + C.GoString(C.sqlite3_sql(s.s)))
+	defer C.free(unsafe.Pointer(query))
+	var stmt *C.sqlite3_stmt
+	if rv := C.sqlite3_prepare_v2(s.c.db, query, -1, &stmt, nil); rv != C.SQLITE_OK {
+		return nil, s.c.lastError()
+	}
+	defer C.sqlite3_finalize(stmt)
+
+	var plan []QueryPlanRow
+	for {
+		switch rv := C.sqlite3_step(stmt); rv {
+		case C.SQLITE_ROW:
+			plan = append(plan, QueryPlanRow{
+				ID:     int(C.sqlite3_column_int(stmt, 0)),
+				Parent: int(C.sqlite3_column_int(stmt, 1)),
+				Detail: C.GoString((*C.char)(unsafe.Pointer(C.sqlite3_column_text(stmt, 3)))),
+			})
+		case C.SQLITE_DONE:
+			return plan, nil
+		default:
+			return nil, s.c.lastError()
+		}
+	}
+}
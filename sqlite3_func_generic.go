@@ -0,0 +1,215 @@
+// Copyright (C) 2019 Yasuhiro Matsumoto <mattn.jp@gmail.com>.
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file.
+
+//go:build cgo && go1.18
+// +build cgo,go1.18
+
+package sqlite3
+
+import (
+	"errors"
+	"fmt"
+	"reflect"
+	"unsafe"
+)
+
+// FuncValue lists the argument and result types of the functions
+// registered with RegisterFunc1 and RegisterFunc2. They are converted as
+// RegisterFunc converts them.
+type FuncValue interface {
+	~int | ~int8 | ~int16 | ~int32 | ~int64 | ~uint8 | ~uint16 | ~uint32 |
+		~float32 | ~float64 | ~bool | ~string | ~[]byte
+}
+
+// RegisterFunc1 makes fn available as the SQLite function name taking one
+// argument. It behaves like RegisterFunc, but the conversions of the
+// argument and result are resolved from the type parameters when the
+// function is registered, so calls do not go through reflection.
+//
+// This is a function rather than a method of SQLiteConn because methods
+// cannot have type parameters.
+func RegisterFunc1[A, R FuncValue](c *SQLiteConn, name string, fn func(A) R, pure bool) error {
+	if fn == nil {
+		return errors.New("nil function passed to RegisterFunc1")
+	}
+	argA, ret := funcArg[A](), funcResult[R]()
+	return c.RegisterFuncRaw(name, 1, func(ctx *SQLiteContext, args []*SQLiteValue) {
+		a, err := argA(args[0])
+		if err != nil {
+			ctx.ResultError(fmt.Errorf("argument 1: %w", err))
+			return
+		}
+		ret(ctx, fn(a))
+	}, pure)
+}
+
+// RegisterFunc2 is like RegisterFunc1 for functions taking two arguments.
+func RegisterFunc2[A, B, R FuncValue](c *SQLiteConn, name string, fn func(A, B) R, pure bool) error {
+	if fn == nil {
+		return errors.New("nil function passed to RegisterFunc2")
+	}
+	argA, argB, ret := funcArg[A](), funcArg[B](), funcResult[R]()
+	return c.RegisterFuncRaw(name, 2, func(ctx *SQLiteContext, args []*SQLiteValue) {
+		a, err := argA(args[0])
+		if err != nil {
+			ctx.ResultError(fmt.Errorf("argument 1: %w", err))
+			return
+		}
+		b, err := argB(args[1])
+		if err != nil {
+			ctx.ResultError(fmt.Errorf("argument 2: %w", err))
+			return
+		}
+		ret(ctx, fn(a, b))
+	}, pure)
+}
+
+var (
+	errArgInteger = errors.New("argument must be an INTEGER")
+	errArgFloat   = errors.New("argument must be a FLOAT")
+	errArgText    = errors.New("argument must be BLOB or TEXT")
+)
+
+// as reinterprets u as T, which must have the same underlying type.
+func as[T, U any](u U) T {
+	return *(*T)(unsafe.Pointer(&u))
+}
+
+// funcArg returns the converter of arguments of type T.
+func funcArg[T FuncValue]() func(*SQLiteValue) (T, error) {
+	var zero T
+	integer := func(v *SQLiteValue) (int64, error) {
+		if v.Kind() != ColumnInt64 {
+			return 0, errArgInteger
+		}
+		return v.Int64(), nil
+	}
+	float := func(v *SQLiteValue) (float64, error) {
+		if v.Kind() != ColumnFloat64 {
+			return 0, errArgFloat
+		}
+		return v.Float64(), nil
+	}
+	switch reflect.TypeOf(&zero).Elem().Kind() {
+	case reflect.Int:
+		return func(v *SQLiteValue) (T, error) { i, err := integer(v); return as[T](int(i)), err }
+	case reflect.Int8:
+		return func(v *SQLiteValue) (T, error) { i, err := integer(v); return as[T](int8(i)), err }
+	case reflect.Int16:
+		return func(v *SQLiteValue) (T, error) { i, err := integer(v); return as[T](int16(i)), err }
+	case reflect.Int32:
+		return func(v *SQLiteValue) (T, error) { i, err := integer(v); return as[T](int32(i)), err }
+	case reflect.Int64:
+		return func(v *SQLiteValue) (T, error) { i, err := integer(v); return as[T](i), err }
+	case reflect.Uint8:
+		return func(v *SQLiteValue) (T, error) { i, err := integer(v); return as[T](uint8(i)), err }
+	case reflect.Uint16:
+		return func(v *SQLiteValue) (T, error) { i, err := integer(v); return as[T](uint16(i)), err }
+	case reflect.Uint32:
+		return func(v *SQLiteValue) (T, error) { i, err := integer(v); return as[T](uint32(i)), err }
+	case reflect.Bool:
+		return func(v *SQLiteValue) (T, error) { i, err := integer(v); return as[T](i != 0), err }
+	case reflect.Float32:
+		return func(v *SQLiteValue) (T, error) { f, err := float(v); return as[T](float32(f)), err }
+	case reflect.Float64:
+		return func(v *SQLiteValue) (T, error) { f, err := float(v); return as[T](f), err }
+	case reflect.String:
+		return func(v *SQLiteValue) (T, error) {
+			if k := v.Kind(); k != ColumnText && k != ColumnBlob {
+				return zero, errArgText
+			}
+			return as[T](v.Text()), nil
+		}
+	default: // []byte
+		return func(v *SQLiteValue) (T, error) {
+			if k := v.Kind(); k != ColumnText && k != ColumnBlob {
+				return zero, errArgText
+			}
+			return as[T](v.Blob()), nil
+		}
+	}
+}
+
+// funcResult returns the function setting results of type T.
+func funcResult[T FuncValue]() func(*SQLiteContext, T) {
+	var zero T
+	switch reflect.TypeOf(&zero).Elem().Kind() {
+	case reflect.Int:
+		return func(ctx *SQLiteContext, r T) { ctx.ResultInt64(int64(as[int](r))) }
+	case reflect.Int8:
+		return func(ctx *SQLiteContext, r T) { ctx.ResultInt64(int64(as[int8](r))) }
+	case reflect.Int16:
+		return func(ctx *SQLiteContext, r T) { ctx.ResultInt64(int64(as[int16](r))) }
+	case reflect.Int32:
+		return func(ctx *SQLiteContext, r T) { ctx.ResultInt64(int64(as[int32](r))) }
+	case reflect.Int64:
+		return func(ctx *SQLiteContext, r T) { ctx.ResultInt64(as[int64](r)) }
+	case reflect.Uint8:
+		return func(ctx *SQLiteContext, r T) { ctx.ResultInt64(int64(as[uint8](r))) }
+	case reflect.Uint16:
+		return func(ctx *SQLiteContext, r T) { ctx.ResultInt64(int64(as[uint16](r))) }
+	case reflect.Uint32:
+		return func(ctx *SQLiteContext, r T) { ctx.ResultInt64(int64(as[uint32](r))) }
+	case reflect.Bool:
+		return func(ctx *SQLiteContext, r T) { ctx.ResultBool(as[bool](r)) }
+	case reflect.Float32:
+		return func(ctx *SQLiteContext, r T) { ctx.ResultDouble(float64(as[float32](r))) }
+	case reflect.Float64:
+		return func(ctx *SQLiteContext, r T) { ctx.ResultDouble(as[float64](r)) }
+	case reflect.String:
+		return func(ctx *SQLiteContext, r T) { ctx.ResultText(as[string](r)) }
+	default: // []byte
+		return func(ctx *SQLiteContext, r T) {
+			if b := as[[]byte](r); len(b) > 0 {
+				ctx.ResultBlob(b)
+			} else {
+				ctx.ResultNull()
+			}
+		}
+	}
+}
+
+// Aggregator1 is the state of an aggregation registered with
+// RegisterAggregator1.
+type Aggregator1[A, R FuncValue] interface {
+	Step(A)
+	Done() R
+}
+
+// RegisterAggregator1 makes an aggregation function taking one argument
+// available as the SQLite function name. It behaves like
+// RegisterAggregator, but the conversions of the argument and result are
+// resolved from the type parameters when the function is registered, and
+// the methods of the state are called without reflection:
+//
+//	RegisterAggregator1[int64, int64](conn, "custom_sum", newSum, true)
+func RegisterAggregator1[A, R FuncValue, T Aggregator1[A, R]](c *SQLiteConn, name string, impl func() T, pure bool) error {
+	if impl == nil {
+		return errors.New("nil constructor passed to RegisterAggregator1")
+	}
+	argA, ret := funcArg[A](), funcResult[R]()
+	return c.RegisterAggregatorRaw(name, 1, func() RawAggregator {
+		return &typedAggregator1[A, R]{state: impl(), arg: argA, ret: ret}
+	}, pure)
+}
+
+type typedAggregator1[A, R FuncValue] struct {
+	state Aggregator1[A, R]
+	arg   func(*SQLiteValue) (A, error)
+	ret   func(*SQLiteContext, R)
+}
+
+func (ta *typedAggregator1[A, R]) Step(ctx *SQLiteContext, args []*SQLiteValue) {
+	a, err := ta.arg(args[0])
+	if err != nil {
+		ctx.ResultError(fmt.Errorf("argument 1: %w", err))
+		return
+	}
+	ta.state.Step(a)
+}
+
+func (ta *typedAggregator1[A, R]) Done(ctx *SQLiteContext) {
+	ta.ret(ctx, ta.state.Done())
+}
@@ -0,0 +1,207 @@
+// Copyright (C) 2019 Yasuhiro Matsumoto <mattn.jp@gmail.com>.
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file.
+
+//go:build cgo && go1.18
+// +build cgo,go1.18
+
+package sqlite3
+
+import (
+	"bytes"
+	"database/sql"
+	"strings"
+	"sync"
+	"testing"
+)
+
+var typedFunctionsOnce sync.Once
+
+// openTypedFunctions opens a database with the same function registered
+// through RegisterFunc, RegisterFunc2 and RegisterFuncRaw.
+func openTypedFunctions(t testing.TB) *sql.DB {
+	typedFunctionsOnce.Do(func() {
+		sql.Register("sqlite3_TypedFunctions", &SQLiteDriver{
+			ConnectHook: func(conn *SQLiteConn) error {
+				add := func(a, b int64) int64 { return a + b }
+				if err := conn.RegisterFunc("add_reflect", add, false); err != nil {
+					return err
+				}
+				if err := RegisterFunc2(conn, "add_generic", add, false); err != nil {
+					return err
+				}
+				if err := conn.RegisterFuncRaw("add_raw", 2, func(ctx *SQLiteContext, args []*SQLiteValue) {
+					ctx.ResultInt64(args[0].Int64() + args[1].Int64())
+				}, false); err != nil {
+					return err
+				}
+				if err := RegisterAggregator1[int64, int64](conn, "typed_sum", func() *sumAggregator { return new(sumAggregator) }, true); err != nil {
+					return err
+				}
+				type celsius float64
+				if err := RegisterFunc1(conn, "fahrenheit", func(c celsius) float32 { return float32(c*9/5 + 32) }, true); err != nil {
+					return err
+				}
+				if err := RegisterFunc1(conn, "not", func(b bool) bool { return !b }, true); err != nil {
+					return err
+				}
+				if err := RegisterFunc2(conn, "repeat", func(s string, n uint8) string { return strings.Repeat(s, int(n)) }, true); err != nil {
+					return err
+				}
+				if err := RegisterFunc1(conn, "reverse", func(b []byte) []byte {
+					r := make([]byte, len(b))
+					for i := range b {
+						r[len(b)-1-i] = b[i]
+					}
+					return r
+				}, true); err != nil {
+					return err
+				}
+				return conn.RegisterFuncRaw("kinds", -1, func(ctx *SQLiteContext, args []*SQLiteValue) {
+					var b strings.Builder
+					for _, v := range args {
+						switch v.Kind() {
+						case ColumnInt64:
+							b.WriteByte('i')
+						case ColumnFloat64:
+							b.WriteByte('f')
+						case ColumnText:
+							b.WriteByte('t')
+						case ColumnBlob:
+							b.WriteByte('b')
+						case ColumnNull:
+							b.WriteByte('n')
+						}
+					}
+					ctx.ResultText(b.String())
+				}, true)
+			},
+		})
+	})
+	db, err := sql.Open("sqlite3_TypedFunctions", ":memory:")
+	if err != nil {
+		t.Fatal("Failed to open database:", err)
+	}
+	return db
+}
+
+func TestTypedFunctions(t *testing.T) {
+	db := openTypedFunctions(t)
+	defer db.Close()
+
+	for _, name := range []string{"add_reflect", "add_generic", "add_raw"} {
+		var n int64
+		if err := db.QueryRow("SELECT " + name + "(40, 2)").Scan(&n); err != nil {
+			t.Fatal(name, err)
+		}
+		if n != 42 {
+			t.Fatalf("%s: want 42, got %d", name, n)
+		}
+	}
+
+	var f float64
+	if err := db.QueryRow("SELECT fahrenheit(100.0)").Scan(&f); err != nil {
+		t.Fatal(err)
+	}
+	if f != 212 {
+		t.Fatalf("fahrenheit: want 212, got %v", f)
+	}
+	var b bool
+	if err := db.QueryRow("SELECT not(0)").Scan(&b); err != nil {
+		t.Fatal(err)
+	}
+	if !b {
+		t.Fatal("not: want true")
+	}
+	var s string
+	if err := db.QueryRow("SELECT repeat('ab', 3)").Scan(&s); err != nil {
+		t.Fatal(err)
+	}
+	if s != "ababab" {
+		t.Fatalf("repeat: want ababab, got %q", s)
+	}
+	var blob []byte
+	if err := db.QueryRow("SELECT reverse(x'010203')").Scan(&blob); err != nil {
+		t.Fatal(err)
+	}
+	if !bytes.Equal(blob, []byte{3, 2, 1}) {
+		t.Fatalf("reverse: want 030201, got %x", blob)
+	}
+	var null interface{}
+	if err := db.QueryRow("SELECT reverse(x'')").Scan(&null); err != nil {
+		t.Fatal(err)
+	}
+	if null != nil {
+		t.Fatalf("reverse: want NULL, got %v", null)
+	}
+	if err := db.QueryRow("SELECT kinds(1, 1.5, 'a', x'00', NULL)").Scan(&s); err != nil {
+		t.Fatal(err)
+	}
+	if s != "iftbn" {
+		t.Fatalf("kinds: want iftbn, got %q", s)
+	}
+
+	var sum int64
+	if err := db.QueryRow("SELECT typed_sum(i) FROM (SELECT 1 AS i UNION ALL SELECT 2 UNION ALL SELECT 39)").Scan(&sum); err != nil {
+		t.Fatal(err)
+	}
+	if sum != 42 {
+		t.Fatalf("typed_sum: want 42, got %d", sum)
+	}
+
+	errs := map[string]string{
+		"SELECT typed_sum('x')":       "argument 1: argument must be an INTEGER",
+		"SELECT add_generic(1, 'x')":  "argument 2: argument must be an INTEGER",
+		"SELECT fahrenheit(100)":      "argument 1: argument must be a FLOAT",
+		"SELECT repeat(1, 2)":         "argument 1: argument must be BLOB or TEXT",
+		"SELECT add_generic(1, NULL)": "argument 2: argument must be an INTEGER",
+	}
+	for query, want := range errs {
+		err := db.QueryRow(query).Scan(&s)
+		if err == nil || err.Error() != want {
+			t.Fatalf("%s: want error %q, got %v", query, want, err)
+		}
+	}
+}
+
+func BenchmarkCustomFunctionsTyped(b *testing.B) {
+	db := openTypedFunctions(b)
+	defer db.Close()
+	db.SetMaxOpenConns(1)
+
+	for _, name := range []string{"add_reflect", "add_generic", "add_raw"} {
+		b.Run(strings.TrimPrefix(name, "add_"), func(b *testing.B) {
+			query := "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 1000) SELECT sum(" + name + "(i, i)) FROM n"
+			b.ReportAllocs()
+			b.ResetTimer()
+			for i := 0; i < b.N; i++ {
+				var n int64
+				if err := db.QueryRow(query).Scan(&n); err != nil {
+					b.Fatal(err)
+				}
+				if n != 1001000 {
+					b.Fatalf("want 1001000, got %d", n)
+				}
+			}
+		})
+	}
+}
+
+var typedAggregatorOnce sync.Once
+
+func BenchmarkAggregatorTyped(b *testing.B) {
+	typedAggregatorOnce.Do(func() {
+		sql.Register("sqlite3_BenchmarkAggregatorTyped", &SQLiteDriver{
+			ConnectHook: func(conn *SQLiteConn) error {
+				return RegisterAggregator1[int64, int64](conn, "typedSum", func() *sumAggregator { return new(sumAggregator) }, true)
+			},
+		})
+	})
+	db, err := sql.Open("sqlite3_BenchmarkAggregatorTyped", ":memory:")
+	if err != nil {
+		b.Fatal("Failed to open database:", err)
+	}
+	defer db.Close()
+	benchmarkAggregatorSum(b, db, "typedSum")
+}
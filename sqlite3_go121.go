@@ -0,0 +1,54 @@
+// Copyright (C) 2019 Yasuhiro Matsumoto <mattn.jp@gmail.com>.
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file.
+
+//go:build cgo && go1.21
+// +build cgo,go1.21
+
+package sqlite3
+
+import (
+	"runtime"
+	"unsafe"
+)
+
+// bindPins keeps the Go memory of arguments bound with SQLITE_STATIC in
+// place until the statement has been stepped and its bindings cleared.
+type bindPins struct {
+	p runtime.Pinner
+	n int
+}
+
+// minPinSize is the size below which arguments are copied by SQLite rather
+// than pinned, as the copy is cheaper than pinning.
+const minPinSize = 256
+
+// pin pins the n bytes at ptr and reports whether they may be bound with
+// SQLITE_STATIC. Small values are left to SQLITE_TRANSIENT, and so is
+// memory Go did not allocate, such as an mmap'd slice, for which Pin
+// panics.
+func (bp *bindPins) pin(ptr unsafe.Pointer, n int) (ok bool) {
+	if n < minPinSize {
+		return false
+	}
+	defer func() {
+		if recover() != nil {
+			ok = false
+		}
+	}()
+	bp.p.Pin(ptr)
+	bp.n++
+	return true
+}
+
+func (bp *bindPins) pinned() bool {
+	return bp.n > 0
+}
+
+func (bp *bindPins) unpin() {
+	if bp.n > 0 {
+		bp.p.Unpin()
+		bp.n = 0
+	}
+}
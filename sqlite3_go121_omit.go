@@ -0,0 +1,23 @@
+// Copyright (C) 2019 Yasuhiro Matsumoto <mattn.jp@gmail.com>.
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file.
+
+//go:build cgo && !go1.21
+// +build cgo,!go1.21
+
+package sqlite3
+
+import (
+	"unsafe"
+)
+
+// bindPins is a no-op before Go 1.21, which lacks runtime.Pinner; arguments
+// are always bound with SQLITE_TRANSIENT there.
+type bindPins struct{}
+
+func (bp *bindPins) pin(ptr unsafe.Pointer, n int) bool { return false }
+
+func (bp *bindPins) pinned() bool { return false }
+
+func (bp *bindPins) unpin() {}
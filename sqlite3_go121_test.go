@@ -0,0 +1,73 @@
+// Copyright (C) 2019 Yasuhiro Matsumoto <mattn.jp@gmail.com>.
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file.
+
+//go:build cgo && go1.21 && (linux || darwin)
+// +build cgo
+// +build go1.21
+// +build linux darwin
+
+package sqlite3
+
+import (
+	"bytes"
+	"database/sql"
+	"syscall"
+	"testing"
+	"unsafe"
+)
+
+func TestBindForeignMemory(t *testing.T) {
+	// Memory Go did not allocate cannot be pinned; it is copied instead.
+	b, err := syscall.Mmap(-1, 0, 4096, syscall.PROT_READ|syscall.PROT_WRITE, syscall.MAP_ANON|syscall.MAP_PRIVATE)
+	if err != nil {
+		t.Skip("mmap:", err)
+	}
+	defer syscall.Munmap(b)
+	for i := range b {
+		b[i] = byte(i)
+	}
+
+	db, err := sql.Open("sqlite3", ":memory:")
+	if err != nil {
+		t.Fatal("Failed to open database:", err)
+	}
+	defer db.Close()
+	db.SetMaxOpenConns(1)
+	if _, err = db.Exec("create table foo (b blob, s text)"); err != nil {
+		t.Fatal("Failed to create table:", err)
+	}
+	// A string sharing the mapped memory.
+	foreign := *(*string)(unsafe.Pointer(&b))
+	foreign = foreign[:1000]
+	stmt, err := db.Prepare("insert into foo values (?, ?)")
+	if err != nil {
+		t.Fatal("Failed to prepare:", err)
+	}
+	defer stmt.Close()
+	if _, err = stmt.Exec(b, string(b[:300])); err != nil {
+		t.Fatal("Failed to insert:", err)
+	}
+	if _, err = stmt.Exec(b[:300], foreign); err != nil {
+		t.Fatal("Failed to insert:", err)
+	}
+
+	rows, err := db.Query("select b, s from foo")
+	if err != nil {
+		t.Fatal("Failed to query:", err)
+	}
+	defer rows.Close()
+	for _, want := range [][2][]byte{{b, b[:300]}, {b[:300], b[:1000]}} {
+		var gotB, gotS []byte
+		if !rows.Next() {
+			t.Fatal("missing row:", rows.Err())
+		}
+		if err = rows.Scan(&gotB, &gotS); err != nil {
+			t.Fatal(err)
+		}
+		if !bytes.Equal(gotB, want[0]) || !bytes.Equal(gotS, want[1]) {
+			t.Fatalf("unexpected values of %d and %d bytes", len(gotB), len(gotS))
+		}
+	}
+}
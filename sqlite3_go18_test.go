@@ -56,6 +56,31 @@ func TestNamedParams(t *testing.T) {
 	}
 }
 
+func BenchmarkNamedParams(b *testing.B) {
+	db, err := sql.Open("sqlite3", ":memory:")
+	if err != nil {
+		b.Fatal("Failed to open database:", err)
+	}
+	defer db.Close()
+
+	st, err := db.Prepare(`select :id, @name, $extra`)
+	if err != nil {
+		b.Fatal("Failed to prepare:", err)
+	}
+	defer st.Close()
+
+	b.ReportAllocs()
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		var id int
+		var name, extra string
+		err = st.QueryRow(sql.Named("id", i), sql.Named("name", "foo"), sql.Named("extra", "bar")).Scan(&id, &name, &extra)
+		if err != nil {
+			b.Fatal("Failed to query:", err)
+		}
+	}
+}
+
 var (
 	testTableStatements = []string{
 		`DROP TABLE IF EXISTS test_table`,
@@ -289,6 +314,168 @@ func TestExecCancel(t *testing.T) {
 	}
 }
 
+func TestNestedContextQueries(t *testing.T) {
+	db, err := sql.Open("sqlite3", ":memory:")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer db.Close()
+	db.SetMaxOpenConns(1)
+
+	if _, err = db.Exec("create table foo (id integer primary key); create table bar (id integer)"); err != nil {
+		t.Fatal(err)
+	}
+	for n := 0; n < 10; n++ {
+		if _, err = db.Exec("insert into foo (id) values (?)", n); err != nil {
+			t.Fatal(err)
+		}
+	}
+
+	conn, err := db.Conn(context.Background())
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer conn.Close()
+
+	ctx, cancel := context.WithCancel(context.Background())
+	defer cancel()
+	rows, err := conn.QueryContext(ctx, "select id from foo order by id")
+	if err != nil {
+		t.Fatal(err)
+	}
+	seen := 0
+	for rows.Next() {
+		var id int
+		if err = rows.Scan(&id); err != nil {
+			t.Fatal(err)
+		}
+		// The inner exec overlaps the watch of the outer query.
+		execCtx, execCancel := context.WithCancel(context.Background())
+		_, err = conn.ExecContext(execCtx, "insert into bar (id) values (?)", id)
+		execCancel()
+		if err != nil {
+			t.Fatal(err)
+		}
+		seen++
+		if seen == 5 {
+			cancel()
+		}
+	}
+	if err = rows.Err(); err != context.Canceled {
+		t.Fatalf("expected %v after cancel, got %v", context.Canceled, err)
+	}
+	if seen != 5 {
+		t.Fatalf("expected iteration to stop after 5 rows, got %d", seen)
+	}
+
+	var n int
+	if err = conn.QueryRowContext(context.Background(), "select count(*) from bar").Scan(&n); err != nil {
+		t.Fatal(err)
+	}
+	if n != 5 {
+		t.Fatalf("expected 5 rows in bar, got %d", n)
+	}
+}
+
+func BenchmarkQueryContext(b *testing.B) {
+	db, err := sql.Open("sqlite3", ":memory:")
+	if err != nil {
+		b.Fatal(err)
+	}
+	defer db.Close()
+	db.SetMaxOpenConns(1)
+	_, err = db.Exec(`create table foo (id integer primary key);
+		with recursive n(i) as (select 1 union all select i+1 from n where i < 1000)
+		insert into foo select i from n`)
+	if err != nil {
+		b.Fatal(err)
+	}
+
+	ctx, cancel := context.WithCancel(context.Background())
+	defer cancel()
+	for name, ctx := range map[string]context.Context{"Background": context.Background(), "WithCancel": ctx} {
+		b.Run(name, func(b *testing.B) {
+			b.ReportAllocs()
+			for i := 0; i < b.N; i++ {
+				rows, err := db.QueryContext(ctx, "select id from foo")
+				if err != nil {
+					b.Fatal(err)
+				}
+				var id int
+				for rows.Next() {
+					if err = rows.Scan(&id); err != nil {
+						b.Fatal(err)
+					}
+				}
+				rows.Close()
+			}
+		})
+	}
+}
+
+func TestBeginTxOptions(t *testing.T) {
+	tempFilename := TempFilename(t)
+	defer os.Remove(tempFilename)
+	db1, err := sql.Open("sqlite3", tempFilename+"?_busy_timeout=0")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer db1.Close()
+	db2, err := sql.Open("sqlite3", tempFilename+"?_busy_timeout=0")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer db2.Close()
+	db1.SetMaxOpenConns(1)
+	if _, err = db1.Exec("create table foo (id integer)"); err != nil {
+		t.Fatal(err)
+	}
+	ctx := context.Background()
+
+	// Read-only transactions are deferred and reject writes.
+	tx, err := db1.BeginTx(ctx, &sql.TxOptions{ReadOnly: true})
+	if err != nil {
+		t.Fatal(err)
+	}
+	if _, err = tx.Exec("insert into foo values(1)"); err == nil {
+		t.Fatal("expected insert in a read-only transaction to fail")
+	}
+	if _, err = db2.Exec("insert into foo values(1)"); err != nil {
+		t.Fatal("read-only transaction should not hold the write lock:", err)
+	}
+	if err = tx.Commit(); err != nil {
+		t.Fatal(err)
+	}
+	// query_only is turned back off afterwards.
+	if _, err = db1.Exec("insert into foo values(2)"); err != nil {
+		t.Fatal("expected insert after a read-only transaction to succeed:", err)
+	}
+
+	// Serializable takes the write lock when the transaction begins.
+	for _, level := range []sql.IsolationLevel{sql.LevelSerializable, sql.LevelLinearizable} {
+		tx, err = db1.BeginTx(ctx, &sql.TxOptions{Isolation: level})
+		if err != nil {
+			t.Fatal(err)
+		}
+		if _, err = db2.Exec("insert into foo values(3)"); err == nil {
+			t.Fatalf("%v: expected the write lock to be held", level)
+		}
+		if err = tx.Rollback(); err != nil {
+			t.Fatal(err)
+		}
+	}
+
+	// The default level follows _txlock, deferred here.
+	tx, err = db1.BeginTx(ctx, nil)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if _, err = db2.Exec("insert into foo values(4)"); err != nil {
+		t.Fatal("deferred transaction should not hold the write lock:", err)
+	}
+	tx.Rollback()
+}
+
 func doTestOpenContext(t *testing.T, option string) (string, error) {
 	tempFilename := TempFilename(t)
 	url := tempFilename + option
@@ -0,0 +1,236 @@
+// Copyright (C) 2019 Yasuhiro Matsumoto <mattn.jp@gmail.com>.
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file.
+
+//go:build cgo
+// +build cgo
+
+package sqlite3
+
+import (
+	"context"
+	"database/sql/driver"
+	"strings"
+	"sync"
+	"sync/atomic"
+	"time"
+)
+
+// groupCommit runs the Exec calls of a _pool=rw pool on its writer,
+// several of them per transaction. Every request runs inside its own
+// savepoint, so one failing statement does not undo the others, and the
+// callers share a single COMMIT.
+type groupCommit struct {
+	p        *rwPool
+	maxBatch int
+	delay    time.Duration
+	queue    chan *gcRequest
+	done     chan struct{}
+}
+
+type gcRequest struct {
+	ctx   context.Context
+	query string
+	args  []driver.NamedValue
+	res   driver.Result
+	err   error
+	reply chan struct{}
+	state int32 // gcPending until the leader runs it or the caller leaves
+}
+
+// States of a gcRequest. Whichever of the leader and the caller moves the
+// request out of gcPending decides who puts it back into gcRequestPool.
+const (
+	gcPending   int32 = iota
+	gcRunning         // the leader started it, the caller waits for the reply
+	gcDone            // the leader replies, the caller recycles the request
+	gcAbandoned       // the caller left, the leader recycles the request
+)
+
+var gcRequestPool = sync.Pool{
+	New: func() interface{} { return &gcRequest{reply: make(chan struct{}, 1)} },
+}
+
+func newGroupCommit(p *rwPool, maxBatch int, delay time.Duration) *groupCommit {
+	g := &groupCommit{
+		p:        p,
+		maxBatch: maxBatch,
+		delay:    delay,
+		queue:    make(chan *gcRequest, maxBatch),
+		done:     make(chan struct{}),
+	}
+	go g.run()
+	return g
+}
+
+// batchable reports whether query may share a transaction with others.
+// Transaction control and statements that cannot run in a transaction are
+// executed on their own.
+func batchable(query string) bool {
+	q := strings.TrimLeft(query, " \t\r\n(")
+	if len(q) > 9 {
+		q = q[:9]
+	}
+	q = strings.ToUpper(q)
+	for _, prefix := range []string{"BEGIN", "COMMIT", "END", "ROLLBACK", "SAVEPOINT", "RELEASE", "VACUUM", "PRAGMA", "ATTACH", "DETACH"} {
+		if strings.HasPrefix(q, prefix) {
+			return false
+		}
+	}
+	return true
+}
+
+// exec queues query and waits for its result, or for ctx to be done. The
+// leader skips a request abandoned that way. Once the leader has started
+// it, the request runs to completion, as interrupting a statement would
+// roll back the whole shared transaction, and exec returns its result even
+// if ctx is done meanwhile, so that the caller knows whether it committed.
+func (g *groupCommit) exec(ctx context.Context, query string, args []driver.NamedValue) (driver.Result, error) {
+	r := gcRequestPool.Get().(*gcRequest)
+	r.ctx, r.query, r.args = ctx, query, args
+	select {
+	case g.queue <- r:
+	case <-ctx.Done():
+		r.ctx, r.args = nil, nil
+		gcRequestPool.Put(r)
+		return nil, ctx.Err()
+	}
+	select {
+	case <-r.reply:
+	case <-ctx.Done():
+		if atomic.CompareAndSwapInt32(&r.state, gcPending, gcAbandoned) {
+			return nil, ctx.Err()
+		}
+		// The leader is running the request or replying.
+		<-r.reply
+	}
+	res, err := r.res, r.err
+	*r = gcRequest{reply: r.reply}
+	gcRequestPool.Put(r)
+	return res, err
+}
+
+func (g *groupCommit) close() {
+	close(g.queue)
+	<-g.done
+}
+
+func (g *groupCommit) run() {
+	defer close(g.done)
+	batch := make([]*gcRequest, 0, g.maxBatch)
+	var timer *time.Timer
+	for r := range g.queue {
+		batch = append(batch[:0], r)
+		if g.delay > 0 {
+			if timer == nil {
+				timer = time.NewTimer(g.delay)
+			} else {
+				timer.Reset(g.delay)
+			}
+		}
+	collect:
+		for len(batch) < g.maxBatch {
+			var r *gcRequest
+			var ok bool
+			if g.delay > 0 {
+				select {
+				case r, ok = <-g.queue:
+				case <-timer.C:
+					break collect
+				}
+			} else {
+				select {
+				case r, ok = <-g.queue:
+				default:
+					break collect
+				}
+			}
+			if !ok {
+				break
+			}
+			batch = append(batch, r)
+		}
+		if timer != nil && !timer.Stop() {
+			select {
+			case <-timer.C:
+			default:
+			}
+		}
+
+		if w, err := g.p.acquireWriter(context.Background()); err != nil {
+			for _, r := range batch {
+				r.err = err
+			}
+		} else {
+			g.commit(w, batch)
+			g.p.writer <- w
+		}
+		for _, r := range batch {
+			if atomic.CompareAndSwapInt32(&r.state, gcRunning, gcDone) ||
+				atomic.CompareAndSwapInt32(&r.state, gcPending, gcDone) {
+				r.reply <- struct{}{}
+			} else {
+				*r = gcRequest{reply: r.reply}
+				gcRequestPool.Put(r)
+			}
+		}
+	}
+}
+
+// commit runs batch on the writer w in as few transactions as possible.
+func (g *groupCommit) commit(w *SQLiteConn, batch []*gcRequest) {
+	bg := context.Background()
+	for i := 0; i < len(batch); {
+		start := i
+		if _, err := w.exec(bg, "BEGIN IMMEDIATE", nil); err != nil {
+			for ; i < len(batch); i++ {
+				batch[i].err = err
+			}
+			return
+		}
+		for ; i < len(batch); i++ {
+			r := batch[i]
+			if !atomic.CompareAndSwapInt32(&r.state, gcPending, gcRunning) {
+				continue // abandoned
+			}
+			if err := r.ctx.Err(); err != nil {
+				r.err = err
+				continue
+			}
+			if _, r.err = w.exec(bg, "SAVEPOINT _group_commit", nil); r.err != nil {
+				continue
+			}
+			r.res, r.err = w.exec(bg, r.query, r.args)
+			if r.err == nil {
+				w.exec(bg, "RELEASE _group_commit", nil)
+				continue
+			}
+			if w.AutoCommit() {
+				// SQLite rolled back the transaction (I/O error, full
+				// disk, ...); the requests before this one are lost too.
+				for _, prev := range batch[start:i] {
+					if prev.err == nil {
+						prev.res, prev.err = nil, r.err
+					}
+				}
+				i++
+				break
+			}
+			w.exec(bg, "ROLLBACK TO _group_commit", nil)
+			w.exec(bg, "RELEASE _group_commit", nil)
+			r.res = nil
+		}
+		if w.AutoCommit() {
+			continue
+		}
+		if _, err := w.exec(bg, "COMMIT", nil); err != nil {
+			w.exec(bg, "ROLLBACK", nil)
+			for _, r := range batch[start:i] {
+				if r.err == nil {
+					r.res, r.err = nil, err
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,72 @@
+// Copyright (C) 2019 Yasuhiro Matsumoto <mattn.jp@gmail.com>.
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file.
+
+//go:build cgo
+// +build cgo
+
+package sqlite3
+
+/*
+#ifndef USE_LIBSQLITE3
+#include "sqlite3-binding.h"
+#else
+#include <sqlite3.h>
+#endif
+*/
+import "C"
+
+// MemoryStats holds the process-wide memory counters of SQLite reported by
+// sqlite3_status64. Highwater values are the largest seen since the last
+// reset.
+type MemoryStats struct {
+	MemoryUsed                 int64 // bytes allocated through sqlite3_malloc
+	MemoryUsedHighwater        int64
+	MallocCount                int64 // outstanding allocations
+	MallocCountHighwater       int64
+	MallocSizeHighwater        int64 // largest allocation requested
+	PagecacheUsed              int64 // pages used from the SQLITE_CONFIG_PAGECACHE buffer
+	PagecacheUsedHighwater     int64
+	PagecacheOverflow          int64 // bytes of page cache allocated from the heap instead
+	PagecacheOverflowHighwater int64
+	PagecacheSizeHighwater     int64 // largest page cache allocation requested
+}
+
+// MemoryStatus returns the memory counters of SQLite, and resets the
+// highwater marks to the current values when reset is true.
+func MemoryStatus(reset bool) MemoryStats {
+	r := C.int(0)
+	if reset {
+		r = 1
+	}
+	get := func(op C.int) (int64, int64) {
+		var cur, hi C.sqlite3_int64
+		C.sqlite3_status64(op, &cur, &hi, r)
+		return int64(cur), int64(hi)
+	}
+	var s MemoryStats
+	s.MemoryUsed, s.MemoryUsedHighwater = get(C.SQLITE_STATUS_MEMORY_USED)
+	s.MallocCount, s.MallocCountHighwater = get(C.SQLITE_STATUS_MALLOC_COUNT)
+	_, s.MallocSizeHighwater = get(C.SQLITE_STATUS_MALLOC_SIZE)
+	s.PagecacheUsed, s.PagecacheUsedHighwater = get(C.SQLITE_STATUS_PAGECACHE_USED)
+	s.PagecacheOverflow, s.PagecacheOverflowHighwater = get(C.SQLITE_STATUS_PAGECACHE_OVERFLOW)
+	_, s.PagecacheSizeHighwater = get(C.SQLITE_STATUS_PAGECACHE_SIZE)
+	return s
+}
+
+// SetSoftHeapLimit sets the advisory limit on the memory SQLite allocates
+// for the whole process, and returns the previous one. Once the limit is
+// reached, page caches recycle their own pages rather than growing. 0
+// removes the limit and a negative value only queries it.
+func SetSoftHeapLimit(limit int64) int64 {
+	return int64(C.sqlite3_soft_heap_limit64(C.sqlite3_int64(limit)))
+}
+
+// SetHardHeapLimit sets the limit on the memory SQLite allocates for the
+// whole process, and returns the previous one. Allocations that would
+// exceed it fail with SQLITE_NOMEM. 0 removes the limit and a negative
+// value only queries it.
+func SetHardHeapLimit(limit int64) int64 {
+	return int64(C.sqlite3_hard_heap_limit64(C.sqlite3_int64(limit)))
+}
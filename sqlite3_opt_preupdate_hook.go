@@ -37,10 +37,14 @@ import (
 // removed. If callback is nil the existing hook (if any) will be removed
 // without creating a new one.
 func (c *SQLiteConn) RegisterPreUpdateHook(callback func(SQLitePreUpdateData)) {
+	var prev unsafe.Pointer
 	if callback == nil {
-		C.sqlite3_preupdate_hook(c.db, nil, nil)
+		prev = C.sqlite3_preupdate_hook(c.db, nil, nil)
 	} else {
-		C.sqlite3_preupdate_hook(c.db, (*[0]byte)(unsafe.Pointer(C.preUpdateHookTrampoline)), unsafe.Pointer(newHandle(c, callback)))
+		prev = C.sqlite3_preupdate_hook(c.db, (*[0]byte)(unsafe.Pointer(C.preUpdateHookTrampoline)), unsafe.Pointer(newHandle(c, callback)))
+	}
+	if prev != nil {
+		deleteHandle(c, prev)
 	}
 }
 
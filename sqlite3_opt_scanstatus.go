@@ -0,0 +1,97 @@
+// Copyright (C) 2019 Yasuhiro Matsumoto <mattn.jp@gmail.com>.
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file.
+
+// +build sqlite_scanstatus
+
+package sqlite3
+
+/*
+#cgo CFLAGS: -DSQLITE_ENABLE_STMT_SCANSTATUS
+#cgo CFLAGS: -DSQLITE_ENABLE_BYTECODE_VTAB
+#ifndef USE_LIBSQLITE3
+#include "sqlite3-binding.h"
+#else
+#include <sqlite3.h>
+#endif
+
+// _sqlite3_scanstatus reads loop idx of s. Before 3.42 there are no cycle
+// counters nor parent ids, and only the scans are reported.
+static int
+_sqlite3_scanstatus(sqlite3_stmt *s, int idx, sqlite3_int64 *loops, sqlite3_int64 *visits, double *est,
+                    const char **name, const char **explain, int *selectid, int *parentid, sqlite3_int64 *cycles)
+{
+#if SQLITE_VERSION_NUMBER >= 3042000
+	int f = SQLITE_SCANSTAT_COMPLEX;
+	if (sqlite3_stmt_scanstatus_v2(s, idx, SQLITE_SCANSTAT_SELECTID, f, selectid)) {
+		return 1;
+	}
+	sqlite3_stmt_scanstatus_v2(s, idx, SQLITE_SCANSTAT_PARENTID, f, parentid);
+	sqlite3_stmt_scanstatus_v2(s, idx, SQLITE_SCANSTAT_NLOOP, f, loops);
+	sqlite3_stmt_scanstatus_v2(s, idx, SQLITE_SCANSTAT_NVISIT, f, visits);
+	sqlite3_stmt_scanstatus_v2(s, idx, SQLITE_SCANSTAT_EST, f, est);
+	sqlite3_stmt_scanstatus_v2(s, idx, SQLITE_SCANSTAT_NAME, f, name);
+	sqlite3_stmt_scanstatus_v2(s, idx, SQLITE_SCANSTAT_EXPLAIN, f, explain);
+	if (sqlite3_stmt_scanstatus_v2(s, idx, SQLITE_SCANSTAT_NCYCLE, f, cycles)) {
+		*cycles = -1;
+	}
+#else
+	if (sqlite3_stmt_scanstatus(s, idx, SQLITE_SCANSTAT_SELECTID, selectid)) {
+		return 1;
+	}
+	sqlite3_stmt_scanstatus(s, idx, SQLITE_SCANSTAT_NLOOP, loops);
+	sqlite3_stmt_scanstatus(s, idx, SQLITE_SCANSTAT_NVISIT, visits);
+	sqlite3_stmt_scanstatus(s, idx, SQLITE_SCANSTAT_EST, est);
+	sqlite3_stmt_scanstatus(s, idx, SQLITE_SCANSTAT_NAME, name);
+	sqlite3_stmt_scanstatus(s, idx, SQLITE_SCANSTAT_EXPLAIN, explain);
+	*parentid = 0;
+	*cycles = -1;
+#endif
+	return 0;
+}
+*/
+import "C"
+import (
+	"errors"
+)
+
+// ScanStatus returns the loops of the statement with their counters, and
+// resets the counters when reset is true. Collecting them costs little, so
+// the statistics of a sample of statements may be taken in production.
+func (s *SQLiteStmt) ScanStatus(reset bool) ([]ScanStatus, error) {
+	s.mu.Lock()
+	defer s.mu.Unlock()
+	if s.closed || s.s == nil {
+		return nil, errors.New("sqlite statement is closed")
+	}
+	var status []ScanStatus
+	for i := 0; ; i++ {
+		var loops, visits, cycles C.sqlite3_int64
+		var est C.double
+		var name, explain *C.char
+		var selectID, parentID C.int
+		if C._sqlite3_scanstatus(s.s, C.int(i), &loops, &visits, &est, &name, &explain, &selectID, &parentID, &cycles) != 0 {
+			break
+		}
+		st := ScanStatus{
+			SelectID:  int(selectID),
+			ParentID:  int(parentID),
+			Loops:     int64(loops),
+			Visits:    int64(visits),
+			Estimated: float64(est),
+			Cycles:    int64(cycles),
+		}
+		if name != nil {
+			st.Name = C.GoString(name)
+		}
+		if explain != nil {
+			st.Explain = C.GoString(explain)
+		}
+		status = append(status, st)
+	}
+	if reset {
+		C.sqlite3_stmt_scanstatus_reset(s.s)
+	}
+	return status, nil
+}
@@ -0,0 +1,20 @@
+// Copyright (C) 2019 Yasuhiro Matsumoto <mattn.jp@gmail.com>.
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file.
+
+// +build !sqlite_scanstatus,cgo
+
+package sqlite3
+
+import (
+	"errors"
+)
+
+// ScanStatus returns the loops of the statement with their counters, and
+// resets the counters when reset is true.
+//
+// It requires the sqlite_scanstatus build tag.
+func (s *SQLiteStmt) ScanStatus(reset bool) ([]ScanStatus, error) {
+	return nil, errors.New("sqlite3: ScanStatus requires the sqlite_scanstatus build tag")
+}
@@ -0,0 +1,71 @@
+// Copyright (C) 2019 Yasuhiro Matsumoto <mattn.jp@gmail.com>.
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file.
+
+// +build sqlite_scanstatus
+
+package sqlite3
+
+import (
+	"database/sql/driver"
+	"testing"
+)
+
+func TestScanStatus(t *testing.T) {
+	d := SQLiteDriver{}
+	conn, err := d.Open(":memory:")
+	if err != nil {
+		t.Fatal("failed to get connection to source database:", err)
+	}
+	defer conn.Close()
+	c := conn.(*SQLiteConn)
+	if _, err = c.Exec("create table foo (id integer primary key, v integer)", nil); err != nil {
+		t.Fatal(err)
+	}
+	for i := 0; i < 50; i++ {
+		if _, err = c.Exec("insert into foo(v) values(?)", []driver.Value{i}); err != nil {
+			t.Fatal(err)
+		}
+	}
+
+	s, err := c.Prepare("select count(*) from foo where v % 2 = 0")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer s.Close()
+	for i := 0; i < 3; i++ {
+		rows, err := s.Query(nil)
+		if err != nil {
+			t.Fatal(err)
+		}
+		dest := make([]driver.Value, 1)
+		for rows.Next(dest) == nil {
+		}
+		rows.Close()
+	}
+
+	status, err := s.(*SQLiteStmt).ScanStatus(true)
+	if err != nil {
+		t.Fatal(err)
+	}
+	var scan *ScanStatus
+	for i := range status {
+		if status[i].Name == "foo" {
+			scan = &status[i]
+		}
+	}
+	if scan == nil || scan.Loops != 3 || scan.Visits != 150 || scan.Explain == "" {
+		t.Fatalf("unexpected scan status: %+v", status)
+	}
+
+	status, err = s.(*SQLiteStmt).ScanStatus(false)
+	if err != nil {
+		t.Fatal(err)
+	}
+	for _, st := range status {
+		if st.Loops != 0 || st.Visits != 0 {
+			t.Fatalf("expected counters to be reset: %+v", status)
+		}
+	}
+}
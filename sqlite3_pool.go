@@ -0,0 +1,570 @@
+// Copyright (C) 2019 Yasuhiro Matsumoto <mattn.jp@gmail.com>.
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file.
+
+//go:build cgo
+// +build cgo
+
+package sqlite3
+
+import (
+	"context"
+	"database/sql/driver"
+	"errors"
+	"fmt"
+	"net/url"
+	"runtime"
+	"strconv"
+	"strings"
+	"sync"
+	"time"
+)
+
+// maxRouteCache bounds the number of query texts whose routing is memoized.
+const maxRouteCache = 4096
+
+// rwPools holds the pools shared by the connections opened with _pool=rw,
+// keyed by driver and DSN.
+var rwPools = struct {
+	sync.Mutex
+	m map[rwPoolKey]*rwPool
+}{m: map[rwPoolKey]*rwPool{}}
+
+type rwPoolKey struct {
+	d   *SQLiteDriver
+	dsn string
+}
+
+// rwPool owns one writer connection and up to size query_only reader
+// connections to the same database. The connections handed to database/sql
+// are rwConns, which borrow a physical connection for every operation.
+type rwPool struct {
+	key       rwPoolKey
+	readerDSN string
+	size      int
+	writer    chan *SQLiteConn // holds the writer while it is idle
+	readers   chan *SQLiteConn // idle readers
+	gc        *groupCommit     // nil unless _group_commit is set
+	busy      time.Duration    // how long to wait for the writer
+
+	mu      sync.Mutex
+	refs    int
+	opened  []*SQLiteConn // readers opened so far
+	opening int           // readers being opened, counted against size
+
+	routeMu sync.Mutex
+	routes  map[string]rwRoute
+}
+
+// rwRoute is what the pool remembers about a query text.
+type rwRoute struct {
+	readonly bool
+	numInput int
+}
+
+// poolConfig is the part of a DSN that configures a _pool=rw pool.
+type poolConfig struct {
+	writerDSN   string
+	readerDSN   string
+	readers     int // 0 if no pool was requested
+	groupCommit int
+	groupDelay  time.Duration
+	busyTimeout time.Duration
+}
+
+// poolParams extracts _pool, _readers and the group commit options from
+// dsn, and derives the DSNs of the writer and of the readers.
+func poolParams(dsn string) (poolConfig, error) {
+	var cfg poolConfig
+	pos := strings.IndexRune(dsn, '?')
+	if pos < 1 {
+		return cfg, nil
+	}
+	params, err := url.ParseQuery(dsn[pos+1:])
+	if err != nil {
+		return cfg, err
+	}
+	mode := params.Get("_pool")
+	if mode == "" {
+		if params.Get("_group_commit") != "" {
+			return cfg, errors.New("_group_commit requires _pool=rw")
+		}
+		return cfg, nil
+	}
+	if mode != "rw" {
+		return cfg, fmt.Errorf("Invalid _pool: %v, expecting rw", mode)
+	}
+	cfg.readers = runtime.NumCPU()
+	cfg.busyTimeout = 5000 * time.Millisecond
+	for _, key := range []string{"_busy_timeout", "_timeout"} {
+		if val := params.Get(key); val != "" {
+			iv, err := strconv.ParseInt(val, 10, 64)
+			if err != nil {
+				return cfg, fmt.Errorf("Invalid _busy_timeout: %v: %v", val, err)
+			}
+			cfg.busyTimeout = time.Duration(iv) * time.Millisecond
+		}
+	}
+	if val := params.Get("_readers"); val != "" {
+		iv, err := strconv.ParseInt(val, 10, 32)
+		if err != nil || iv < 1 {
+			return cfg, fmt.Errorf("Invalid _readers: %v, expecting a positive integer", val)
+		}
+		cfg.readers = int(iv)
+	}
+	if val := params.Get("_group_commit"); val != "" {
+		iv, err := strconv.ParseInt(val, 10, 32)
+		if err != nil || iv < 0 {
+			return cfg, fmt.Errorf("Invalid _group_commit: %v, expecting a non-negative integer", val)
+		}
+		cfg.groupCommit = int(iv)
+	}
+	if val := params.Get("_group_commit_delay"); val != "" {
+		d, err := time.ParseDuration(val)
+		if err != nil || d < 0 {
+			return cfg, fmt.Errorf("Invalid _group_commit_delay: %v, expecting a non-negative duration", val)
+		}
+		cfg.groupDelay = d
+	}
+	for _, key := range []string{"_pool", "_readers", "_group_commit", "_group_commit_delay"} {
+		params.Del(key)
+	}
+	cfg.writerDSN = dsn[:pos] + "?" + params.Encode()
+	params.Set("_query_only", "1")
+	cfg.readerDSN = dsn[:pos] + "?" + params.Encode()
+	return cfg, nil
+}
+
+// openPool returns a connection backed by the shared pool for the writer
+// DSN of cfg, creating the pool and its writer on first use.
+func (d *SQLiteDriver) openPool(cfg poolConfig) (driver.Conn, error) {
+	key := rwPoolKey{d, cfg.writerDSN}
+	rwPools.Lock()
+	defer rwPools.Unlock()
+	p := rwPools.m[key]
+	if p == nil {
+		w, err := d.Open(cfg.writerDSN)
+		if err != nil {
+			return nil, err
+		}
+		p = &rwPool{
+			key:       key,
+			readerDSN: cfg.readerDSN,
+			size:      cfg.readers,
+			writer:    make(chan *SQLiteConn, 1),
+			readers:   make(chan *SQLiteConn, cfg.readers),
+			routes:    make(map[string]rwRoute),
+			busy:      cfg.busyTimeout,
+		}
+		p.writer <- w.(*SQLiteConn)
+		if cfg.groupCommit > 0 {
+			p.gc = newGroupCommit(p, cfg.groupCommit, cfg.groupDelay)
+		}
+		rwPools.m[key] = p
+	}
+	p.mu.Lock()
+	p.refs++
+	p.mu.Unlock()
+	return &rwConn{p: p}, nil
+}
+
+// release drops a reference and closes every connection with the last one.
+func (p *rwPool) release() error {
+	rwPools.Lock()
+	defer rwPools.Unlock()
+	p.mu.Lock()
+	defer p.mu.Unlock()
+	if p.refs--; p.refs > 0 {
+		return nil
+	}
+	delete(rwPools.m, p.key)
+	if p.gc != nil {
+		p.gc.close()
+	}
+	err := (<-p.writer).Close()
+	for _, r := range p.opened {
+		if cerr := r.Close(); err == nil {
+			err = cerr
+		}
+	}
+	p.opened = nil
+	return err
+}
+
+// errWriterBusy is returned when the writer of a pool stays in use for
+// longer than the busy timeout.
+var errWriterBusy = Error{Code: ErrBusy, err: "sqlite3: timed out waiting for the writer of the pool"}
+
+// acquireWriter waits for the writer. Like SQLite waiting on a locked
+// database, it gives up with ErrBusy after the busy timeout of the DSN,
+// since the writer may be held by a transaction that is never finished.
+func (p *rwPool) acquireWriter(ctx context.Context) (*SQLiteConn, error) {
+	select {
+	case w := <-p.writer:
+		return w, nil
+	default:
+	}
+	timer := time.NewTimer(p.busy)
+	defer timer.Stop()
+	select {
+	case w := <-p.writer:
+		return w, nil
+	case <-ctx.Done():
+		return nil, ctx.Err()
+	case <-timer.C:
+		return nil, errWriterBusy
+	}
+}
+
+func (p *rwPool) acquireReader(ctx context.Context) (*SQLiteConn, error) {
+	select {
+	case r := <-p.readers:
+		return r, nil
+	default:
+	}
+	p.mu.Lock()
+	if len(p.opened)+p.opening < p.size {
+		p.opening++
+		p.mu.Unlock()
+		c, err := p.key.d.Open(p.readerDSN)
+		p.mu.Lock()
+		p.opening--
+		if err != nil {
+			p.mu.Unlock()
+			return nil, err
+		}
+		r := c.(*SQLiteConn)
+		p.opened = append(p.opened, r)
+		p.mu.Unlock()
+		return r, nil
+	}
+	p.mu.Unlock()
+	select {
+	case r := <-p.readers:
+		return r, nil
+	case <-ctx.Done():
+		return nil, ctx.Err()
+	}
+}
+
+// put returns a connection acquired from the pool.
+func (p *rwPool) put(c *SQLiteConn, writer bool) {
+	if writer {
+		p.writer <- c
+	} else {
+		p.readers <- c
+	}
+}
+
+// route reports whether query is a single read-only statement and how many
+// arguments it takes, preparing it on c the first time it is seen. If c is
+// a reader that cannot prepare query, for instance because it uses a temp
+// table of the writer, the statement is routed to the writer.
+func (p *rwPool) route(ctx context.Context, c *SQLiteConn, reader bool, query string) (rwRoute, error) {
+	p.routeMu.Lock()
+	rt, ok := p.routes[query]
+	p.routeMu.Unlock()
+	if ok {
+		return rt, nil
+	}
+	ds, err := c.prepareCached(ctx, query)
+	if err != nil && reader {
+		var w *SQLiteConn
+		if w, err = p.acquireWriter(ctx); err != nil {
+			return rwRoute{}, err
+		}
+		ds, err = w.prepareCached(ctx, query)
+		if err == nil {
+			s := ds.(*SQLiteStmt)
+			rt = rwRoute{numInput: s.NumInput()}
+			s.Close()
+		}
+		p.put(w, true)
+		if err != nil {
+			return rwRoute{}, err
+		}
+	} else if err != nil {
+		return rwRoute{}, err
+	} else {
+		s := ds.(*SQLiteStmt)
+		rt = rwRoute{readonly: reader && s.s != nil && s.Readonly() && strings.TrimSpace(s.t) == "", numInput: s.NumInput()}
+		s.Close()
+		if !reader {
+			// Only a reader tells whether the query can run on one.
+			return rt, nil
+		}
+	}
+	p.routeMu.Lock()
+	if len(p.routes) >= maxRouteCache {
+		p.routes = make(map[string]rwRoute)
+	}
+	p.routes[query] = rt
+	p.routeMu.Unlock()
+	return rt, nil
+}
+
+// rwConn is the connection returned by Open for a DSN with _pool=rw.
+// Outside of a transaction, Exec runs on the writer and Query on a reader
+// when the statement is read-only. A transaction keeps the connection it
+// started on, a reader if it is read-only and the writer otherwise, until
+// it ends.
+type rwConn struct {
+	p        *rwPool
+	tx       *SQLiteConn
+	txWriter bool
+	closed   bool
+}
+
+// rwTx ends the transaction of an rwConn and gives its connection back.
+type rwTx struct {
+	c  *rwConn
+	tx driver.Tx
+}
+
+// rwStmt is a statement of an rwConn. It is prepared on the physical
+// connection it runs on, through that connection's statement cache if any.
+type rwStmt struct {
+	c     *rwConn
+	query string
+	rt    rwRoute
+}
+
+// rwRows gives the connection back to the pool when closed.
+type rwRows struct {
+	*SQLiteRows
+	release func()
+}
+
+var errPoolConnClosed = errors.New("sqlite3: connection is closed")
+
+// Ping implement Pinger.
+func (c *rwConn) Ping(ctx context.Context) error {
+	if c.closed {
+		return driver.ErrBadConn
+	}
+	return nil
+}
+
+// Prepare the query string. Return a new statement.
+func (c *rwConn) Prepare(query string) (driver.Stmt, error) {
+	return c.PrepareContext(context.Background(), query)
+}
+
+// PrepareContext implement ConnPrepareContext.
+func (c *rwConn) PrepareContext(ctx context.Context, query string) (driver.Stmt, error) {
+	if c.closed {
+		return nil, errPoolConnClosed
+	}
+	var rt rwRoute
+	var err error
+	if c.tx != nil {
+		rt, err = c.p.route(ctx, c.tx, !c.txWriter, query)
+	} else {
+		var r *SQLiteConn
+		if r, err = c.p.acquireReader(ctx); err != nil {
+			return nil, err
+		}
+		rt, err = c.p.route(ctx, r, true, query)
+		c.p.put(r, false)
+	}
+	if err != nil {
+		return nil, err
+	}
+	return &rwStmt{c: c, query: query, rt: rt}, nil
+}
+
+// ExecContext implement ExecerContext.
+func (c *rwConn) ExecContext(ctx context.Context, query string, args []driver.NamedValue) (driver.Result, error) {
+	if c.closed {
+		return nil, errPoolConnClosed
+	}
+	if c.tx != nil {
+		return c.tx.exec(ctx, query, args)
+	}
+	if c.p.gc != nil && batchable(query) {
+		return c.p.gc.exec(ctx, query, args)
+	}
+	w, err := c.p.acquireWriter(ctx)
+	if err != nil {
+		return nil, err
+	}
+	defer c.p.put(w, true)
+	return w.exec(ctx, query, args)
+}
+
+// QueryContext implement QueryerContext.
+func (c *rwConn) QueryContext(ctx context.Context, query string, args []driver.NamedValue) (driver.Rows, error) {
+	if c.closed {
+		return nil, errPoolConnClosed
+	}
+	if c.tx != nil {
+		return c.tx.query(ctx, query, args)
+	}
+	r, err := c.p.acquireReader(ctx)
+	if err != nil {
+		return nil, err
+	}
+	rt, err := c.p.route(ctx, r, true, query)
+	if err != nil {
+		c.p.put(r, false)
+		return nil, err
+	}
+	return c.queryOn(ctx, r, rt.readonly, query, args)
+}
+
+// queryOn runs query on reader r if readonly, and on the writer otherwise,
+// in which case r, if any, is given back.
+func (c *rwConn) queryOn(ctx context.Context, r *SQLiteConn, readonly bool, query string, args []driver.NamedValue) (driver.Rows, error) {
+	pc, writer := r, false
+	if !readonly {
+		if r != nil {
+			c.p.put(r, false)
+		}
+		w, err := c.p.acquireWriter(ctx)
+		if err != nil {
+			return nil, err
+		}
+		pc, writer = w, true
+	}
+	rows, err := pc.query(ctx, query, args)
+	if err != nil {
+		c.p.put(pc, writer)
+		return nil, err
+	}
+	return &rwRows{
+		SQLiteRows: rows.(*SQLiteRows),
+		release:    func() { c.p.put(pc, writer) },
+	}, nil
+}
+
+// Begin transaction.
+func (c *rwConn) Begin() (driver.Tx, error) {
+	return c.BeginTx(context.Background(), driver.TxOptions{})
+}
+
+// BeginTx implement ConnBeginTx.
+func (c *rwConn) BeginTx(ctx context.Context, opts driver.TxOptions) (driver.Tx, error) {
+	if c.closed {
+		return nil, errPoolConnClosed
+	}
+	if c.tx != nil {
+		return nil, errors.New("sqlite3: transaction already in progress")
+	}
+	writer := !opts.ReadOnly
+	var pc *SQLiteConn
+	var err error
+	if writer {
+		pc, err = c.p.acquireWriter(ctx)
+	} else {
+		pc, err = c.p.acquireReader(ctx)
+	}
+	if err != nil {
+		return nil, err
+	}
+	tx, err := pc.BeginTx(ctx, opts)
+	if err != nil {
+		c.p.put(pc, writer)
+		return nil, err
+	}
+	c.tx, c.txWriter = pc, writer
+	return &rwTx{c: c, tx: tx}, nil
+}
+
+// endTx gives the connection of the transaction back to the pool.
+func (c *rwConn) endTx() {
+	if c.tx != nil {
+		c.p.put(c.tx, c.txWriter)
+		c.tx = nil
+	}
+}
+
+// Close the connection.
+func (c *rwConn) Close() error {
+	if c.closed {
+		return nil
+	}
+	if c.tx != nil {
+		c.tx.exec(context.Background(), "ROLLBACK", nil)
+		c.endTx()
+	}
+	c.closed = true
+	return c.p.release()
+}
+
+// Commit transaction.
+func (tx *rwTx) Commit() error {
+	defer tx.c.endTx()
+	return tx.tx.Commit()
+}
+
+// Rollback transaction.
+func (tx *rwTx) Rollback() error {
+	defer tx.c.endTx()
+	return tx.tx.Rollback()
+}
+
+// Close the statement.
+func (s *rwStmt) Close() error {
+	return nil
+}
+
+// NumInput return a number of parameters.
+func (s *rwStmt) NumInput() int {
+	return s.rt.numInput
+}
+
+// Exec execute the statement with arguments. Return result object.
+func (s *rwStmt) Exec(args []driver.Value) (driver.Result, error) {
+	return s.ExecContext(context.Background(), valuesToNamed(args))
+}
+
+// Query the statement with arguments. Return records.
+func (s *rwStmt) Query(args []driver.Value) (driver.Rows, error) {
+	return s.QueryContext(context.Background(), valuesToNamed(args))
+}
+
+// ExecContext implement ExecerContext.
+func (s *rwStmt) ExecContext(ctx context.Context, args []driver.NamedValue) (driver.Result, error) {
+	return s.c.ExecContext(ctx, s.query, args)
+}
+
+// QueryContext implement QueryerContext.
+func (s *rwStmt) QueryContext(ctx context.Context, args []driver.NamedValue) (driver.Rows, error) {
+	c := s.c
+	if c.closed {
+		return nil, errPoolConnClosed
+	}
+	if c.tx != nil {
+		return c.tx.query(ctx, s.query, args)
+	}
+	if !s.rt.readonly {
+		return c.queryOn(ctx, nil, false, s.query, args)
+	}
+	r, err := c.p.acquireReader(ctx)
+	if err != nil {
+		return nil, err
+	}
+	return c.queryOn(ctx, r, true, s.query, args)
+}
+
+// Close the rows.
+func (rc *rwRows) Close() error {
+	err := rc.SQLiteRows.Close()
+	if rc.release != nil {
+		rc.release()
+		rc.release = nil
+	}
+	return err
+}
+
+func valuesToNamed(args []driver.Value) []driver.NamedValue {
+	list := make([]driver.NamedValue, len(args))
+	for i, v := range args {
+		list[i] = driver.NamedValue{
+			Ordinal: i + 1,
+			Value:   v,
+		}
+	}
+	return list
+}
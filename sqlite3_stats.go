@@ -0,0 +1,163 @@
+// Copyright (C) 2019 Yasuhiro Matsumoto <mattn.jp@gmail.com>.
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file.
+
+//go:build cgo
+// +build cgo
+
+package sqlite3
+
+/*
+#ifndef USE_LIBSQLITE3
+#include "sqlite3-binding.h"
+#else
+#include <sqlite3.h>
+#endif
+*/
+import "C"
+import "errors"
+
+// ConnStats holds the counters of a connection reported by
+// sqlite3_db_status. Counters marked cumulative only grow over the life of
+// the connection; the others are current values.
+type ConnStats struct {
+	CacheHit          int64 // pager cache hits, cumulative
+	CacheMiss         int64 // pager cache misses, cumulative
+	CacheWrite        int64 // pages written to disk, cumulative
+	CacheSpill        int64 // dirty pages written before commit, cumulative
+	CacheUsed         int64 // bytes of page cache memory
+	LookasideUsed     int64 // lookaside slots checked out
+	LookasideHit      int64 // allocations served from lookaside, cumulative
+	LookasideMissSize int64 // allocations too large for lookaside, cumulative
+	LookasideMissFull int64 // allocations missed with lookaside full, cumulative
+	SchemaUsed        int64 // bytes of schema memory
+	StmtUsed          int64 // bytes of prepared statement memory
+}
+
+// DriverStats is a snapshot of the connections opened by a SQLiteDriver.
+// The cumulative counters include the connections closed since the driver
+// was created; the other values are summed over the open connections.
+type DriverStats struct {
+	OpenConns int
+	ConnStats
+}
+
+// StmtStats holds the counters of a prepared statement reported by
+// sqlite3_stmt_status, accumulated since it was prepared.
+type StmtStats struct {
+	FullscanSteps int64 // forward steps of full table scans
+	Sorts         int64 // sort operations
+	AutoIndexes   int64 // rows inserted into automatic indexes
+	VMSteps       int64 // virtual machine operations
+	Reprepares    int64 // automatic re-prepares after schema changes
+	Runs          int64 // completed runs
+	MemoryUsed    int64 // bytes of memory used by the statement
+}
+
+// Stats returns the counters of the connection.
+func (c *SQLiteConn) Stats() (ConnStats, error) {
+	c.mu.Lock()
+	defer c.mu.Unlock()
+	if c.db == nil {
+		return ConnStats{}, errors.New("sqlite connection is closed")
+	}
+	return dbStats(c.db), nil
+}
+
+func dbStats(db *C.sqlite3) ConnStats {
+	get := func(op C.int, highwater bool) int64 {
+		var cur, hi C.int
+		C.sqlite3_db_status(db, op, &cur, &hi, 0)
+		if highwater {
+			return int64(hi)
+		}
+		return int64(cur)
+	}
+	return ConnStats{
+		CacheHit:          get(C.SQLITE_DBSTATUS_CACHE_HIT, false),
+		CacheMiss:         get(C.SQLITE_DBSTATUS_CACHE_MISS, false),
+		CacheWrite:        get(C.SQLITE_DBSTATUS_CACHE_WRITE, false),
+		CacheSpill:        get(C.SQLITE_DBSTATUS_CACHE_SPILL, false),
+		CacheUsed:         get(C.SQLITE_DBSTATUS_CACHE_USED, false),
+		LookasideUsed:     get(C.SQLITE_DBSTATUS_LOOKASIDE_USED, false),
+		LookasideHit:      get(C.SQLITE_DBSTATUS_LOOKASIDE_HIT, true),
+		LookasideMissSize: get(C.SQLITE_DBSTATUS_LOOKASIDE_MISS_SIZE, true),
+		LookasideMissFull: get(C.SQLITE_DBSTATUS_LOOKASIDE_MISS_FULL, true),
+		SchemaUsed:        get(C.SQLITE_DBSTATUS_SCHEMA_USED, false),
+		StmtUsed:          get(C.SQLITE_DBSTATUS_STMT_USED, false),
+	}
+}
+
+// add adds the counters of o to s, the cumulative ones only if all is false.
+func (s *ConnStats) add(o ConnStats, all bool) {
+	s.CacheHit += o.CacheHit
+	s.CacheMiss += o.CacheMiss
+	s.CacheWrite += o.CacheWrite
+	s.CacheSpill += o.CacheSpill
+	s.LookasideHit += o.LookasideHit
+	s.LookasideMissSize += o.LookasideMissSize
+	s.LookasideMissFull += o.LookasideMissFull
+	if all {
+		s.CacheUsed += o.CacheUsed
+		s.LookasideUsed += o.LookasideUsed
+		s.SchemaUsed += o.SchemaUsed
+		s.StmtUsed += o.StmtUsed
+	}
+}
+
+// Stats returns a snapshot of the connections opened by the driver.
+// Connections opened with _mutex=no are not thread safe and are left out.
+func (d *SQLiteDriver) Stats() DriverStats {
+	d.mu.Lock()
+	defer d.mu.Unlock()
+	s := DriverStats{OpenConns: len(d.conns)}
+	s.add(d.closed, false)
+	for db := range d.conns {
+		s.add(dbStats(db), true)
+	}
+	return s
+}
+
+// track adds the connection to the driver statistics.
+func (d *SQLiteDriver) track(c *SQLiteConn) {
+	d.mu.Lock()
+	if d.conns == nil {
+		d.conns = map[*C.sqlite3]struct{}{}
+	}
+	d.conns[c.db] = struct{}{}
+	c.driver = d
+	d.mu.Unlock()
+}
+
+// untrack removes the connection from the driver statistics, keeping its
+// cumulative counters. It must be called before the database is closed.
+func (d *SQLiteDriver) untrack(c *SQLiteConn) {
+	d.mu.Lock()
+	if _, ok := d.conns[c.db]; ok {
+		delete(d.conns, c.db)
+		d.closed.add(dbStats(c.db), false)
+	}
+	d.mu.Unlock()
+}
+
+// Stats returns the counters of the statement.
+func (s *SQLiteStmt) Stats() StmtStats {
+	s.mu.Lock()
+	defer s.mu.Unlock()
+	if s.closed || s.s == nil {
+		return StmtStats{}
+	}
+	get := func(op C.int) int64 {
+		return int64(C.sqlite3_stmt_status(s.s, op, 0))
+	}
+	return StmtStats{
+		FullscanSteps: get(C.SQLITE_STMTSTATUS_FULLSCAN_STEP),
+		Sorts:         get(C.SQLITE_STMTSTATUS_SORT),
+		AutoIndexes:   get(C.SQLITE_STMTSTATUS_AUTOINDEX),
+		VMSteps:       get(C.SQLITE_STMTSTATUS_VM_STEP),
+		Reprepares:    get(C.SQLITE_STMTSTATUS_REPREPARE),
+		Runs:          get(C.SQLITE_STMTSTATUS_RUN),
+		MemoryUsed:    get(C.SQLITE_STMTSTATUS_MEMUSED),
+	}
+}
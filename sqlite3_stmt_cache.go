@@ -0,0 +1,165 @@
+// Copyright (C) 2019 Yasuhiro Matsumoto <mattn.jp@gmail.com>.
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file.
+
+//go:build cgo
+// +build cgo
+
+package sqlite3
+
+/*
+#ifndef USE_LIBSQLITE3
+#include "sqlite3-binding.h"
+#else
+#include <sqlite3.h>
+#endif
+*/
+import "C"
+import (
+	"container/list"
+	"context"
+	"database/sql/driver"
+	"runtime"
+	"sync"
+)
+
+// StmtCacheStats reports the activity of a connection's statement cache.
+type StmtCacheStats struct {
+	Capacity  int    // maximum number of idle statements kept
+	Size      int    // number of idle statements currently cached
+	Hits      uint64 // lookups served from the cache
+	Misses    uint64 // lookups that had to prepare a new statement
+	Evictions uint64 // statements finalized to make room for newer ones
+}
+
+// stmtCache is a bounded LRU of idle prepared statements keyed by SQL text.
+// Statements are checked out by get and handed back by put when the caller
+// closes them, so a statement is never shared by two users at once.
+type stmtCache struct {
+	mu       sync.Mutex
+	capacity int
+	lru      *list.List // of *SQLiteStmt, most recently used at the front
+	entries  map[string]*list.Element
+	closed   bool
+
+	hits      uint64
+	misses    uint64
+	evictions uint64
+}
+
+func newStmtCache(capacity int) *stmtCache {
+	return &stmtCache{
+		capacity: capacity,
+		lru:      list.New(),
+		entries:  make(map[string]*list.Element, capacity),
+	}
+}
+
+// get checks out the cached statement for query, or returns nil.
+func (sc *stmtCache) get(query string) *SQLiteStmt {
+	sc.mu.Lock()
+	defer sc.mu.Unlock()
+	e, ok := sc.entries[query]
+	if !ok {
+		sc.misses++
+		return nil
+	}
+	sc.hits++
+	sc.lru.Remove(e)
+	delete(sc.entries, query)
+	s := e.Value.(*SQLiteStmt)
+	s.idle = false
+	return s
+}
+
+// put resets s and returns it to the cache. It must be called with s.mu held.
+// It reports false if the statement was not taken, in which case the caller
+// has to finalize it.
+func (sc *stmtCache) put(s *SQLiteStmt) bool {
+	sc.mu.Lock()
+	defer sc.mu.Unlock()
+	if sc.closed || s.s == nil {
+		return false
+	}
+	if _, dup := sc.entries[s.key]; dup {
+		// Another statement with the same text was checked out concurrently
+		// and came back first; keep that one.
+		return false
+	}
+	C.sqlite3_reset(s.s)
+	C.sqlite3_clear_bindings(s.s)
+	s.cls = false
+	s.idle = true
+	sc.entries[s.key] = sc.lru.PushFront(s)
+	for sc.lru.Len() > sc.capacity {
+		sc.evictions++
+		sc.finalize(sc.lru.Remove(sc.lru.Back()).(*SQLiteStmt))
+	}
+	return true
+}
+
+// finalize releases an idle statement; must be called with sc.mu held.
+func (sc *stmtCache) finalize(s *SQLiteStmt) {
+	delete(sc.entries, s.key)
+	C.sqlite3_finalize(s.s)
+	s.s = nil
+	s.batch.free()
+	s.idle = false
+	s.closed = true
+	runtime.SetFinalizer(s, nil)
+}
+
+// close finalizes every idle statement and stops accepting new ones.
+// Statements still checked out are finalized when their owner closes them.
+func (sc *stmtCache) close() {
+	sc.mu.Lock()
+	defer sc.mu.Unlock()
+	sc.closed = true
+	for e := sc.lru.Front(); e != nil; e = e.Next() {
+		sc.finalize(e.Value.(*SQLiteStmt))
+	}
+	sc.lru.Init()
+}
+
+func (sc *stmtCache) stats() StmtCacheStats {
+	sc.mu.Lock()
+	defer sc.mu.Unlock()
+	return StmtCacheStats{
+		Capacity:  sc.capacity,
+		Size:      sc.lru.Len(),
+		Hits:      sc.hits,
+		Misses:    sc.misses,
+		Evictions: sc.evictions,
+	}
+}
+
+// StmtCacheStats returns the counters of the statement cache enabled with the
+// _stmt_cache DSN parameter. The zero value is returned when it is disabled.
+func (c *SQLiteConn) StmtCacheStats() StmtCacheStats {
+	if c.stmtCache == nil {
+		return StmtCacheStats{}
+	}
+	return c.stmtCache.stats()
+}
+
+// prepareCached is used by Exec and Query. It serves the statement from the
+// cache when one is configured, and prepares cache-owned statements with
+// SQLITE_PREPARE_PERSISTENT otherwise.
+func (c *SQLiteConn) prepareCached(ctx context.Context, query string) (driver.Stmt, error) {
+	if c.stmtCache == nil {
+		return c.prepare(ctx, query)
+	}
+	if s := c.stmtCache.get(query); s != nil {
+		return s, nil
+	}
+	s, err := c.prepareStmt(query, true)
+	if err != nil {
+		return nil, err
+	}
+	if s.s != nil {
+		s.cache = c.stmtCache
+		s.key = query
+	}
+	return s, nil
+}
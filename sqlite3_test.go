@@ -11,6 +11,7 @@ package sqlite3
 
 import (
 	"bytes"
+	"context"
 	"database/sql"
 	"database/sql/driver"
 	"errors"
@@ -19,12 +20,15 @@ import (
 	"math/rand"
 	"net/url"
 	"os"
+	"os/exec"
 	"reflect"
 	"regexp"
 	"runtime"
+	"sort"
 	"strconv"
 	"strings"
 	"sync"
+	"sync/atomic"
 	"testing"
 	"time"
 )
@@ -1554,6 +1558,325 @@ func TestAggregatorRegistration_GenericReturn(t *testing.T) {
 	}
 }
 
+// rawSum is the RawAggregator equivalent of sumAggregator.
+type rawSum int64
+
+func (s *rawSum) Step(ctx *SQLiteContext, args []*SQLiteValue) {
+	*s += rawSum(args[0].Int64())
+}
+
+func (s *rawSum) Done(ctx *SQLiteContext) {
+	ctx.ResultInt64(int64(*s))
+}
+
+func newRawSum() RawAggregator {
+	return new(rawSum)
+}
+
+func TestAggregatorRegistration_Raw(t *testing.T) {
+	sql.Register("sqlite3_AggregatorRegistration_Raw", &SQLiteDriver{
+		ConnectHook: func(conn *SQLiteConn) error {
+			return conn.RegisterAggregatorRaw("rawSum", 1, newRawSum, true)
+		},
+	})
+	db, err := sql.Open("sqlite3_AggregatorRegistration_Raw", ":memory:")
+	if err != nil {
+		t.Fatal("Failed to open database:", err)
+	}
+	defer db.Close()
+
+	_, err = db.Exec("create table foo (department integer, profits integer, costs integer)")
+	if err != nil {
+		t.Fatal("Failed to create table:", err)
+	}
+
+	var sum sql.NullInt64
+	if err := db.QueryRow("select rawSum(profits) from foo").Scan(&sum); err != nil {
+		t.Fatal("Query failed:", err)
+	}
+	if sum.Int64 != 0 {
+		t.Fatalf("Sum of no rows: got %d, want 0", sum.Int64)
+	}
+
+	_, err = db.Exec("insert into foo values (1, 10, 1), (1, 20, 2), (2, 42, 3), (3, 5, 4)")
+	if err != nil {
+		t.Fatal("Failed to insert records:", err)
+	}
+
+	// Several aggregations in flight at once, and slots reused between
+	// groups and queries.
+	for n := 0; n < 3; n++ {
+		rows, err := db.Query("select department, rawSum(profits), rawSum(costs) from foo group by department order by department")
+		if err != nil {
+			t.Fatal("Query failed:", err)
+		}
+		want := [][3]int64{{1, 30, 3}, {2, 42, 3}, {3, 5, 4}}
+		var got [][3]int64
+		for rows.Next() {
+			var r [3]int64
+			if err := rows.Scan(&r[0], &r[1], &r[2]); err != nil {
+				t.Fatal("Scan failed:", err)
+			}
+			got = append(got, r)
+		}
+		rows.Close()
+		if !reflect.DeepEqual(got, want) {
+			t.Fatalf("Custom sum returned wrong values, got %v, want %v", got, want)
+		}
+	}
+}
+
+// movingSum is sumAggregator usable as a window function.
+type movingSum struct {
+	sumAggregator
+}
+
+func (s *movingSum) Inverse(x int64) {
+	s.sumAggregator -= sumAggregator(x)
+}
+
+func (s *movingSum) Value() int64 {
+	return s.Done()
+}
+
+type rawMovingSum struct {
+	rawSum
+}
+
+func (s *rawMovingSum) Inverse(ctx *SQLiteContext, args []*SQLiteValue) {
+	s.rawSum -= rawSum(args[0].Int64())
+}
+
+func (s *rawMovingSum) Value(ctx *SQLiteContext) {
+	s.Done(ctx)
+}
+
+type valueOnlyAggregator struct {
+	sumAggregator
+}
+
+func (s *valueOnlyAggregator) Value() int64 {
+	return s.Done()
+}
+
+type badInverseAggregator struct {
+	movingSum
+}
+
+func (s *badInverseAggregator) Inverse(x float64) {
+	s.sumAggregator -= sumAggregator(x)
+}
+
+func TestAggregatorRegistration_Window(t *testing.T) {
+	var regErrs []error
+	sql.Register("sqlite3_AggregatorRegistration_Window", &SQLiteDriver{
+		ConnectHook: func(conn *SQLiteConn) error {
+			regErrs = []error{
+				conn.RegisterAggregator("valueOnly", func() *valueOnlyAggregator { return new(valueOnlyAggregator) }, true),
+				conn.RegisterAggregator("badInverse", func() *badInverseAggregator { return new(badInverseAggregator) }, true),
+			}
+			if err := conn.RegisterAggregator("movingSum", func() *movingSum { return new(movingSum) }, true); err != nil {
+				return err
+			}
+			return conn.RegisterWindowAggregatorRaw("rawMovingSum", 1, func() RawWindowAggregator { return new(rawMovingSum) }, true)
+		},
+	})
+	db, err := sql.Open("sqlite3_AggregatorRegistration_Window", ":memory:")
+	if err != nil {
+		t.Fatal("Failed to open database:", err)
+	}
+	defer db.Close()
+
+	_, err = db.Exec("create table foo (ts integer primary key, value integer)")
+	if err != nil {
+		t.Fatal("Failed to create table:", err)
+	}
+	for _, err := range regErrs {
+		if err == nil {
+			t.Fatal("Expected an error registering an aggregator with mismatched window methods")
+		}
+	}
+	_, err = db.Exec("insert into foo values (1, 5), (2, 1), (3, 8), (4, 2), (5, 7), (6, 3)")
+	if err != nil {
+		t.Fatal("Failed to insert records:", err)
+	}
+
+	for _, fn := range []string{"movingSum", "rawMovingSum"} {
+		rows, err := db.Query("select " + fn + "(value) over w, sum(value) over w from foo window w as (order by ts rows between 2 preceding and current row)")
+		if err != nil {
+			t.Fatal("Query failed:", err)
+		}
+		n := 0
+		for rows.Next() {
+			var got, want int64
+			if err := rows.Scan(&got, &want); err != nil {
+				t.Fatal("Scan failed:", err)
+			}
+			if got != want {
+				t.Fatalf("%s returned wrong value for row %d, got %d, want %d", fn, n, got, want)
+			}
+			n++
+		}
+		rows.Close()
+		if n != 6 {
+			t.Fatalf("%s returned %d rows, want 6", fn, n)
+		}
+
+		// Still usable as a plain aggregate.
+		var sum int64
+		if err := db.QueryRow("select " + fn + "(value) from foo").Scan(&sum); err != nil {
+			t.Fatal("Query failed:", err)
+		}
+		if sum != 26 {
+			t.Fatalf("%s returned wrong sum, got %d, want 26", fn, sum)
+		}
+	}
+}
+
+var windowBenchOnce sync.Once
+
+// BenchmarkWindowAggregator computes a moving sum over 100 rows with a
+// window function and with the equivalent correlated subquery.
+func BenchmarkWindowAggregator(b *testing.B) {
+	windowBenchOnce.Do(func() {
+		sql.Register("sqlite3_BenchmarkWindowAggregator", &SQLiteDriver{
+			ConnectHook: func(conn *SQLiteConn) error {
+				return conn.RegisterAggregator("movingSum", func() *movingSum { return new(movingSum) }, true)
+			},
+		})
+	})
+	db, err := sql.Open("sqlite3_BenchmarkWindowAggregator", ":memory:")
+	if err != nil {
+		b.Fatal("Failed to open database:", err)
+	}
+	defer db.Close()
+	db.SetMaxOpenConns(1)
+	if _, err := db.Exec("create table foo (ts integer primary key, value integer)"); err != nil {
+		b.Fatal(err)
+	}
+	if _, err := db.Exec("insert into foo WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 10000) SELECT i, i % 97 FROM n"); err != nil {
+		b.Fatal(err)
+	}
+
+	queries := map[string]string{
+		"window":   "select sum(s) from (select movingSum(value) over (order by ts rows between 99 preceding and current row) as s from foo)",
+		"selfjoin": "select sum(s) from (select (select movingSum(b.value) from foo b where b.ts between a.ts - 99 and a.ts) as s from foo a)",
+	}
+	var want int64
+	for _, name := range []string{"window", "selfjoin"} {
+		b.Run(name, func(b *testing.B) {
+			for i := 0; i < b.N; i++ {
+				var sum int64
+				if err := db.QueryRow(queries[name]).Scan(&sum); err != nil {
+					b.Fatal(err)
+				}
+				if want == 0 {
+					want = sum
+				} else if sum != want {
+					b.Fatalf("want %d, got %d", want, sum)
+				}
+			}
+		})
+	}
+}
+
+// benchmarkAggregatorSum sums the integers up to rows with fn, 10 million
+// of them unless -short is given.
+func benchmarkAggregatorSum(b *testing.B, db *sql.DB, fn string) {
+	rows := int64(10000000)
+	if testing.Short() {
+		rows = 100000
+	}
+	query := "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < ?) SELECT " + fn + "(i) FROM n"
+	b.ReportAllocs()
+	b.ResetTimer()
+	start := time.Now()
+	for i := 0; i < b.N; i++ {
+		var sum int64
+		if err := db.QueryRow(query, rows).Scan(&sum); err != nil {
+			b.Fatal(err)
+		}
+		if sum != rows*(rows+1)/2 {
+			b.Fatalf("want %d, got %d", rows*(rows+1)/2, sum)
+		}
+	}
+	b.ReportMetric(float64(time.Since(start).Nanoseconds())/float64(int64(b.N)*rows), "ns/row")
+}
+
+var aggregatorBenchOnce sync.Once
+
+func BenchmarkAggregator(b *testing.B) {
+	aggregatorBenchOnce.Do(func() {
+		sql.Register("sqlite3_BenchmarkAggregator", &SQLiteDriver{
+			ConnectHook: func(conn *SQLiteConn) error {
+				if err := conn.RegisterAggregator("reflectSum", func() *sumAggregator { return new(sumAggregator) }, true); err != nil {
+					return err
+				}
+				return conn.RegisterAggregatorRaw("rawSum", 1, newRawSum, true)
+			},
+		})
+	})
+	db, err := sql.Open("sqlite3_BenchmarkAggregator", ":memory:")
+	if err != nil {
+		b.Fatal("Failed to open database:", err)
+	}
+	defer db.Close()
+
+	b.Run("reflect", func(b *testing.B) { benchmarkAggregatorSum(b, db, "reflectSum") })
+	b.Run("raw", func(b *testing.B) { benchmarkAggregatorSum(b, db, "rawSum") })
+	b.Run("builtin", func(b *testing.B) { benchmarkAggregatorSum(b, db, "sum") })
+}
+
+var collationBenchOnce sync.Once
+
+// BenchmarkCollation sorts 100k strings with NOCASE and its equivalents
+// registered in Go.
+func BenchmarkCollation(b *testing.B) {
+	collationBenchOnce.Do(func() {
+		sql.Register("sqlite3_BenchmarkCollation", &SQLiteDriver{
+			ConnectHook: func(conn *SQLiteConn) error {
+				if err := conn.RegisterCollation("string", func(a, b string) int {
+					return foldCompare([]byte(a), []byte(b))
+				}); err != nil {
+					return err
+				}
+				if err := conn.RegisterCollationBytes("bytes", foldCompare); err != nil {
+					return err
+				}
+				if err := conn.RegisterCollationKey("key", foldKey, 0); err != nil {
+					return err
+				}
+				return conn.RegisterCollationKey("keycached", foldKey, 1<<17)
+			},
+		})
+	})
+	db, err := sql.Open("sqlite3_BenchmarkCollation", ":memory:")
+	if err != nil {
+		b.Fatal("Failed to open database:", err)
+	}
+	defer db.Close()
+	db.SetMaxOpenConns(1)
+	if _, err := db.Exec("create table test (s text)"); err != nil {
+		b.Fatal(err)
+	}
+	if _, err := db.Exec("insert into test WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 100000) SELECT printf('Name %08X', (i * 2654435761) % 1000003) FROM n"); err != nil {
+		b.Fatal(err)
+	}
+
+	for _, coll := range []string{"nocase", "string", "bytes", "key", "keycached"} {
+		b.Run(coll, func(b *testing.B) {
+			query := "select s from test order by s collate " + coll + " limit 1 offset 99999"
+			b.ReportAllocs()
+			for i := 0; i < b.N; i++ {
+				var s string
+				if err := db.QueryRow(query).Scan(&s); err != nil {
+					b.Fatal(err)
+				}
+			}
+		})
+	}
+}
+
 func rot13(r rune) rune {
 	switch {
 	case r >= 'A' && r <= 'Z':
@@ -1675,6 +1998,107 @@ func TestCollationRegistration(t *testing.T) {
 	}
 }
 
+// foldCompare compares ASCII strings case-insensitively, as NOCASE.
+func foldCompare(a, b []byte) int {
+	for i := 0; i < len(a) && i < len(b); i++ {
+		ca, cb := a[i], b[i]
+		if 'A' <= ca && ca <= 'Z' {
+			ca += 'a' - 'A'
+		}
+		if 'A' <= cb && cb <= 'Z' {
+			cb += 'a' - 'A'
+		}
+		if ca != cb {
+			if ca < cb {
+				return -1
+			}
+			return 1
+		}
+	}
+	switch {
+	case len(a) < len(b):
+		return -1
+	case len(a) > len(b):
+		return 1
+	}
+	return 0
+}
+
+// foldKey appends the NOCASE sort key of s to dst.
+func foldKey(dst, s []byte) []byte {
+	for _, c := range s {
+		if 'A' <= c && c <= 'Z' {
+			c += 'a' - 'A'
+		}
+		dst = append(dst, c)
+	}
+	return dst
+}
+
+func TestCollationBytes(t *testing.T) {
+	var keys int
+	sql.Register("sqlite3_CollationBytes", &SQLiteDriver{
+		ConnectHook: func(conn *SQLiteConn) error {
+			if err := conn.RegisterCollationBytes("fold", foldCompare); err != nil {
+				return err
+			}
+			if err := conn.RegisterCollationKey("foldkey", func(dst, s []byte) []byte {
+				keys++
+				return foldKey(dst, s)
+			}, 0); err != nil {
+				return err
+			}
+			return conn.RegisterCollationKey("foldkey2", foldKey, 2)
+		},
+	})
+	db, err := sql.Open("sqlite3_CollationBytes", ":memory:")
+	if err != nil {
+		t.Fatal("Failed to open database:", err)
+	}
+	defer db.Close()
+	db.SetMaxOpenConns(1)
+
+	if _, err := db.Exec("create table test (s text)"); err != nil {
+		t.Fatal("Failed to create table:", err)
+	}
+	if _, err := db.Exec("insert into test values ('b'), ('C'), (''), ('a'), ('B'), ('ab'), ('AA'), ('c')"); err != nil {
+		t.Fatal("Failed to insert records:", err)
+	}
+
+	// The order of equal strings is not defined, so compare folded.
+	want := []string{"", "a", "aa", "ab", "b", "b", "c", "c"}
+	for _, coll := range []string{"nocase", "fold", "foldkey", "foldkey2"} {
+		for _, dir := range []string{"asc", "desc"} {
+			rows, err := db.Query("select lower(s) from test order by s collate " + coll + " " + dir)
+			if err != nil {
+				t.Fatal("Query failed:", err)
+			}
+			var got []string
+			for rows.Next() {
+				var s string
+				if err := rows.Scan(&s); err != nil {
+					t.Fatal("Scan failed:", err)
+				}
+				got = append(got, s)
+			}
+			rows.Close()
+			if dir == "desc" {
+				for i, j := 0, len(got)-1; i < j; i, j = i+1, j-1 {
+					got[i], got[j] = got[j], got[i]
+				}
+			}
+			if !reflect.DeepEqual(got, want) {
+				t.Fatalf("order by %s %s: got %q, want %q", coll, dir, got, want)
+			}
+		}
+	}
+
+	// Every distinct string keyed once, by the first query using foldkey.
+	if keys != 8 {
+		t.Fatalf("expected 8 sort keys to be computed, got %d", keys)
+	}
+}
+
 func TestDeclTypes(t *testing.T) {
 
 	d := SQLiteDriver{}
@@ -1787,6 +2211,42 @@ func TestUpdateAndTransactionHooks(t *testing.T) {
 	}
 }
 
+func TestHookReplacementFreesHandles(t *testing.T) {
+	d := SQLiteDriver{}
+	conn, err := d.Open(":memory:")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer conn.Close()
+	c := conn.(*SQLiteConn)
+
+	base := len(c.handles)
+	var commits, rollbacks, updates, auths int
+	for i := 0; i < 10; i++ {
+		c.RegisterCommitHook(func() int { commits++; return 0 })
+		c.RegisterRollbackHook(func() { rollbacks++ })
+		c.RegisterUpdateHook(func(int, string, string, int64) { updates++ })
+		c.RegisterAuthorizer(func(int, string, string, string) int { auths++; return SQLITE_OK })
+	}
+	if n := len(c.handles) - base; n != 4 {
+		t.Fatalf("expected 4 hook handles, got %d", n)
+	}
+	if _, err = c.Exec("create table foo (id integer primary key); insert into foo values(1)", nil); err != nil {
+		t.Fatal(err)
+	}
+	if commits != 2 || updates != 1 || auths == 0 {
+		t.Fatalf("unexpected hook calls: commits=%d updates=%d auths=%d", commits, updates, auths)
+	}
+
+	c.RegisterCommitHook(nil)
+	c.RegisterRollbackHook(nil)
+	c.RegisterUpdateHook(nil)
+	c.RegisterAuthorizer(nil)
+	if n := len(c.handles) - base; n != 0 {
+		t.Fatalf("expected no hook handles, got %d", n)
+	}
+}
+
 func TestAuthorizer(t *testing.T) {
 	var authorizerReturn = 0
 
@@ -1998,36 +2458,1848 @@ func TestNamedParam(t *testing.T) {
 	}
 }
 
-var customFunctionOnce sync.Once
-
-func BenchmarkCustomFunctions(b *testing.B) {
-	customFunctionOnce.Do(func() {
-		customAdd := func(a, b int64) int64 {
-			return a + b
-		}
-
-		sql.Register("sqlite3_BenchmarkCustomFunctions", &SQLiteDriver{
-			ConnectHook: func(conn *SQLiteConn) error {
-				// Impure function to force sqlite to reexecute it each time.
-				return conn.RegisterFunc("custom_add", customAdd, false)
-			},
-		})
+func TestStmtCache(t *testing.T) {
+	var conn *SQLiteConn
+	sql.Register("sqlite3_TestStmtCache", &SQLiteDriver{
+		ConnectHook: func(c *SQLiteConn) error {
+			conn = c
+			return nil
+		},
 	})
-
-	db, err := sql.Open("sqlite3_BenchmarkCustomFunctions", ":memory:")
+	db, err := sql.Open("sqlite3_TestStmtCache", ":memory:?_stmt_cache=2")
 	if err != nil {
-		b.Fatal("Failed to open database:", err)
+		t.Fatal("Failed to open database:", err)
 	}
 	defer db.Close()
+	db.SetMaxOpenConns(1)
 
-	b.ResetTimer()
-	for i := 0; i < b.N; i++ {
-		var i int64
-		err = db.QueryRow("SELECT custom_add(1,2)").Scan(&i)
-		if err != nil {
-			b.Fatal("Failed to run custom add:", err)
+	if _, err = db.Exec("create table foo (id integer, name text)"); err != nil {
+		t.Fatal("Failed to create table:", err)
+	}
+	for i := 0; i < 10; i++ {
+		if _, err = db.Exec("insert into foo(id, name) values(?, ?)", i, "x"); err != nil {
+			t.Fatal("Failed to insert record:", err)
+		}
+	}
+	stats := conn.StmtCacheStats()
+	if stats.Hits != 9 || stats.Size != 2 || stats.Capacity != 2 {
+		t.Fatalf("unexpected cache stats after inserts: %+v", stats)
+	}
+
+	// A statement that is still in use must not be handed out twice.
+	r1, err := conn.Query("select id from foo order by id", nil)
+	if err != nil {
+		t.Fatal("Failed to query:", err)
+	}
+	r2, err := conn.Query("select id from foo order by id", nil)
+	if err != nil {
+		t.Fatal("Failed to query:", err)
+	}
+	dest := make([]driver.Value, 1)
+	for i := 0; i < 3; i++ {
+		if err = r1.Next(dest); err != nil || dest[0] != int64(i) {
+			t.Fatalf("unexpected row from first cursor: %v %v", dest[0], err)
 		}
 	}
+	if err = r2.Next(dest); err != nil || dest[0] != int64(0) {
+		t.Fatalf("unexpected row from second cursor: %v %v", dest[0], err)
+	}
+	r1.Close()
+	r2.Close()
+
+	for i := 0; i < 3; i++ {
+		var cnt int
+		if err = db.QueryRow("select count(*) from foo where id >= ?", 5).Scan(&cnt); err != nil {
+			t.Fatal("Failed to query:", err)
+		}
+		if cnt != 5 {
+			t.Fatalf("expected 5 rows, got %d", cnt)
+		}
+	}
+	stats = conn.StmtCacheStats()
+	if stats.Evictions == 0 || stats.Size != 2 {
+		t.Fatalf("expected evictions with a full cache: %+v", stats)
+	}
+}
+
+func TestPrefetchRows(t *testing.T) {
+	tempFilename := TempFilename(t)
+	defer os.Remove(tempFilename)
+
+	read := func(dsn string) [][]interface{} {
+		db, err := sql.Open("sqlite3", dsn)
+		if err != nil {
+			t.Fatal("Failed to open database:", err)
+		}
+		defer db.Close()
+		rows, err := db.Query("select id, name, data, amount, ts, flag, note from foo order by id")
+		if err != nil {
+			t.Fatal("Failed to query:", err)
+		}
+		defer rows.Close()
+		var out [][]interface{}
+		for rows.Next() {
+			vals := make([]interface{}, 7)
+			ptrs := make([]interface{}, 7)
+			for i := range vals {
+				ptrs[i] = &vals[i]
+			}
+			if err = rows.Scan(ptrs...); err != nil {
+				t.Fatal("Failed to scan:", err)
+			}
+			out = append(out, vals)
+		}
+		if err = rows.Err(); err != nil {
+			t.Fatal("Failed to iterate:", err)
+		}
+		return out
+	}
+
+	db, err := sql.Open("sqlite3", tempFilename)
+	if err != nil {
+		t.Fatal("Failed to open database:", err)
+	}
+	_, err = db.Exec("create table foo (id integer, name text, data blob, amount real, ts timestamp, flag boolean, note)")
+	if err != nil {
+		t.Fatal("Failed to create table:", err)
+	}
+	now := time.Now().UTC().Truncate(time.Second)
+	for i := 0; i < 250; i++ {
+		var note interface{}
+		if i%3 == 0 {
+			note = strings.Repeat("n", i)
+		}
+		_, err = db.Exec("insert into foo values(?, ?, ?, ?, ?, ?, ?)",
+			i, fmt.Sprint("name", i), bytes.Repeat([]byte{byte(i)}, i%17), float64(i)/3, now.Add(time.Duration(i)*time.Hour), i%2 == 0, note)
+		if err != nil {
+			t.Fatal("Failed to insert record:", err)
+		}
+	}
+	db.Close()
+
+	want := read(tempFilename)
+	if len(want) != 250 {
+		t.Fatalf("expected 250 rows, got %d", len(want))
+	}
+	for _, n := range []int{1, 7, 64, 1000} {
+		got := read(tempFilename + fmt.Sprintf("?_prefetch_rows=%d", n))
+		if !reflect.DeepEqual(got, want) {
+			t.Fatalf("rows differ with _prefetch_rows=%d", n)
+		}
+	}
+}
+
+func BenchmarkPrefetchRows(b *testing.B) {
+	for _, dsn := range []string{":memory:", ":memory:?_prefetch_rows=256"} {
+		b.Run(dsn, func(b *testing.B) {
+			db, err := sql.Open("sqlite3", dsn)
+			if err != nil {
+				b.Fatal("Failed to open database:", err)
+			}
+			defer db.Close()
+			db.SetMaxOpenConns(1)
+			_, err = db.Exec(`create table foo (a integer, b integer, c real, d real, e text, f integer, g integer, h real);
+				with recursive n(i) as (select 1 union all select i+1 from n where i < 10000)
+				insert into foo select i, i*2, i/3.0, i/7.0, 'row' || i, i%5, i%7, i/11.0 from n`)
+			if err != nil {
+				b.Fatal("Failed to create table:", err)
+			}
+
+			b.ReportAllocs()
+			b.ResetTimer()
+			for i := 0; i < b.N; i++ {
+				rows, err := db.Query("select * from foo")
+				if err != nil {
+					b.Fatal("Failed to query:", err)
+				}
+				var a, bb, f, g int64
+				var c, d, h float64
+				var e string
+				for rows.Next() {
+					if err = rows.Scan(&a, &bb, &c, &d, &e, &f, &g, &h); err != nil {
+						b.Fatal("Failed to scan:", err)
+					}
+				}
+				rows.Close()
+			}
+		})
+	}
+}
+
+func BenchmarkStmtCache(b *testing.B) {
+	for _, dsn := range []string{":memory:", ":memory:?_stmt_cache=16"} {
+		b.Run(dsn, func(b *testing.B) {
+			db, err := sql.Open("sqlite3", dsn)
+			if err != nil {
+				b.Fatal("Failed to open database:", err)
+			}
+			defer db.Close()
+			db.SetMaxOpenConns(1)
+			if _, err = db.Exec("create table foo (id integer, name text, amount real)"); err != nil {
+				b.Fatal("Failed to create table:", err)
+			}
+
+			b.ResetTimer()
+			for i := 0; i < b.N; i++ {
+				if _, err = db.Exec("insert into foo(id, name, amount) values(?, ?, ?)", i, "name", 1.5); err != nil {
+					b.Fatal("Failed to insert record:", err)
+				}
+			}
+		})
+	}
+}
+
+func benchmarkBindPayload(b *testing.B, payload func(n int) interface{}) {
+	for _, size := range []int{16, 4096, 65536} {
+		b.Run(strconv.Itoa(size), func(b *testing.B) {
+			db, err := sql.Open("sqlite3", ":memory:")
+			if err != nil {
+				b.Fatal("Failed to open database:", err)
+			}
+			defer db.Close()
+			db.SetMaxOpenConns(1)
+			if _, err = db.Exec("create table foo (v)"); err != nil {
+				b.Fatal("Failed to create table:", err)
+			}
+			st, err := db.Prepare("insert into foo(v) values(?)")
+			if err != nil {
+				b.Fatal("Failed to prepare:", err)
+			}
+			defer st.Close()
+			v := payload(size)
+
+			b.ReportAllocs()
+			b.SetBytes(int64(size))
+			b.ResetTimer()
+			for i := 0; i < b.N; i++ {
+				if _, err = st.Exec(v); err != nil {
+					b.Fatal("Failed to insert record:", err)
+				}
+				if i%1024 == 1023 {
+					b.StopTimer()
+					db.Exec("delete from foo")
+					b.StartTimer()
+				}
+			}
+		})
+	}
+}
+
+func BenchmarkBindText(b *testing.B) {
+	benchmarkBindPayload(b, func(n int) interface{} { return strings.Repeat("x", n) })
+}
+
+func BenchmarkBindBlob(b *testing.B) {
+	benchmarkBindPayload(b, func(n int) interface{} { return bytes.Repeat([]byte{'x'}, n) })
+}
+
+func TestExecBatch(t *testing.T) {
+	d := SQLiteDriver{}
+	dc, err := d.Open(":memory:")
+	if err != nil {
+		t.Fatal("Failed to open database:", err)
+	}
+	conn := dc.(*SQLiteConn)
+	defer conn.Close()
+
+	if _, err = conn.Exec("create table foo (id integer primary key, name text, data blob, f real, ok bool)", nil); err != nil {
+		t.Fatal("Failed to create table:", err)
+	}
+	ds, err := conn.Prepare("insert into foo(id, name, data, f, ok) values(?, ?, ?, ?, ?)")
+	if err != nil {
+		t.Fatal("Failed to prepare:", err)
+	}
+	stmt := ds.(*SQLiteStmt)
+	defer stmt.Close()
+
+	rows := [][]driver.Value{
+		{int64(1), "one", []byte("\x00\x01\x02"), 1.5, true},
+		{int64(2), "", []byte{}, float64(-2), false},
+		{int64(3), nil, nil, nil, nil},
+		{int(4), "four", []byte("x"), float32(4), true},
+	}
+	res, err := stmt.ExecBatch(rows)
+	if err != nil {
+		t.Fatal("Failed to exec batch:", err)
+	}
+	if n, _ := res.RowsAffected(); n != 4 {
+		t.Fatalf("expected 4 rows affected, got %d", n)
+	}
+	if id, _ := res.LastInsertId(); id != 4 {
+		t.Fatalf("expected last insert id 4, got %d", id)
+	}
+
+	r, err := conn.Query("select id, name, typeof(name), data, typeof(data), f, ok from foo order by id", nil)
+	if err != nil {
+		t.Fatal("Failed to query:", err)
+	}
+	want := [][]driver.Value{
+		{int64(1), "one", "text", []byte("\x00\x01\x02"), "blob", 1.5, int64(1)},
+		{int64(2), "", "text", []byte{}, "blob", float64(-2), int64(0)},
+		{int64(3), nil, "null", nil, "null", nil, nil},
+		{int64(4), "four", "text", []byte("x"), "blob", float64(4), int64(1)},
+	}
+	dest := make([]driver.Value, 7)
+	for i := range want {
+		if err = r.Next(dest); err != nil {
+			t.Fatal("Failed to read row:", err)
+		}
+		if !reflect.DeepEqual(dest, want[i]) {
+			t.Fatalf("row %d: expected %v, got %v", i, want[i], dest)
+		}
+	}
+	r.Close()
+
+	// Execution stops at the failing row and reports the rows before it.
+	res, err = stmt.ExecBatch([][]driver.Value{
+		{int64(5), "five", nil, nil, nil},
+		{int64(1), "dup", nil, nil, nil},
+		{int64(6), "six", nil, nil, nil},
+	})
+	if err == nil {
+		t.Fatal("expected constraint error")
+	}
+	if e, ok := err.(Error); !ok || e.Code != ErrConstraint {
+		t.Fatalf("expected constraint error, got %v", err)
+	}
+	if n, _ := res.RowsAffected(); n != 1 {
+		t.Fatalf("expected 1 row affected before failure, got %d", n)
+	}
+	if _, err = stmt.ExecBatch([][]driver.Value{{int64(7)}}); err == nil {
+		t.Fatal("expected argument count error")
+	}
+
+	// The statement stays usable through the regular path.
+	if _, err = stmt.Exec([]driver.Value{int64(8), "eight", nil, nil, nil}); err != nil {
+		t.Fatal("Failed to exec after batch:", err)
+	}
+	r, err = conn.Query("select count(*) from foo", nil)
+	if err != nil {
+		t.Fatal("Failed to query:", err)
+	}
+	defer r.Close()
+	if err = r.Next(dest[:1]); err != nil || dest[0] != int64(6) {
+		t.Fatalf("expected 6 rows, got %v %v", dest[0], err)
+	}
+}
+
+func benchmarkExecBatch(b *testing.B, batch bool) {
+	const n = 10000
+	d := SQLiteDriver{}
+	dc, err := d.Open(":memory:")
+	if err != nil {
+		b.Fatal(err)
+	}
+	conn := dc.(*SQLiteConn)
+	defer conn.Close()
+	if _, err = conn.Exec("create table foo (id integer, name text, f real)", nil); err != nil {
+		b.Fatal(err)
+	}
+	rows := make([][]driver.Value, n)
+	for i := range rows {
+		rows[i] = []driver.Value{int64(i), fmt.Sprintf("name %d", i), float64(i) / 3}
+	}
+	ds, err := conn.Prepare("insert into foo(id, name, f) values(?, ?, ?)")
+	if err != nil {
+		b.Fatal(err)
+	}
+	stmt := ds.(*SQLiteStmt)
+	defer stmt.Close()
+
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		if _, err = conn.Exec("begin", nil); err != nil {
+			b.Fatal(err)
+		}
+		if batch {
+			_, err = stmt.ExecBatch(rows)
+		} else {
+			for _, row := range rows {
+				if _, err = stmt.Exec(row); err != nil {
+					break
+				}
+			}
+		}
+		if err != nil {
+			b.Fatal(err)
+		}
+		if _, err = conn.Exec("rollback", nil); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
+
+func BenchmarkExecRows(b *testing.B)  { benchmarkExecBatch(b, false) }
+func BenchmarkExecBatch(b *testing.B) { benchmarkExecBatch(b, true) }
+
+func TestQueryColumns(t *testing.T) {
+	d := SQLiteDriver{}
+	dc, err := d.Open(":memory:")
+	if err != nil {
+		t.Fatal("Failed to open database:", err)
+	}
+	conn := dc.(*SQLiteConn)
+	defer conn.Close()
+
+	if _, err = conn.Exec("create table foo (id integer, f real, name text, data blob)", nil); err != nil {
+		t.Fatal("Failed to create table:", err)
+	}
+	for i := 0; i < 100; i++ {
+		args := []driver.Value{int64(i), float64(i) / 4, fmt.Sprintf("name %d", i), []byte{byte(i)}}
+		if i%10 == 3 {
+			args = []driver.Value{int64(i), nil, nil, nil}
+		}
+		if _, err = conn.Exec("insert into foo values(?, ?, ?, ?)", args); err != nil {
+			t.Fatal("Failed to insert:", err)
+		}
+	}
+
+	var rows int
+	err = conn.QueryColumns("select id, f, name, data, id * 2 as twice, null as empty from foo where id >= ? order by id", []driver.Value{int64(10)}, 7, func(ch *ColumnChunk) error {
+		if ch.Len > 7 {
+			t.Fatalf("chunk of %d rows exceeds chunk size", ch.Len)
+		}
+		want := []ColumnKind{ColumnInt64, ColumnFloat64, ColumnText, ColumnBlob, ColumnInt64, ColumnNull}
+		for i, v := range ch.Columns {
+			if v.Kind != want[i] {
+				t.Fatalf("column %s: expected kind %d, got %d", v.Name, want[i], v.Kind)
+			}
+		}
+		for r := 0; r < ch.Len; r++ {
+			id := ch.Columns[0].Int64[r]
+			if id != int64(10+rows) {
+				t.Fatalf("expected id %d, got %d", 10+rows, id)
+			}
+			if ch.Columns[4].Int64[r] != id*2 || !ch.Columns[5].IsNull(r) {
+				t.Fatalf("row %d: unexpected expression columns", id)
+			}
+			if id%10 == 3 {
+				for c := 1; c <= 3; c++ {
+					if !ch.Columns[c].IsNull(r) {
+						t.Fatalf("row %d: expected column %d to be NULL", id, c)
+					}
+				}
+			} else {
+				if ch.Columns[1].IsNull(r) || ch.Columns[1].Float64[r] != float64(id)/4 {
+					t.Fatalf("row %d: unexpected float %v", id, ch.Columns[1].Float64[r])
+				}
+				if ch.Columns[2].Text[r] != fmt.Sprintf("name %d", id) {
+					t.Fatalf("row %d: unexpected text %q", id, ch.Columns[2].Text[r])
+				}
+				if b := ch.Columns[3].Bytes(r); len(b) != 1 || b[0] != byte(id) {
+					t.Fatalf("row %d: unexpected blob %v", id, b)
+				}
+			}
+			rows++
+		}
+		return nil
+	})
+	if err != nil {
+		t.Fatal("Failed to query columns:", err)
+	}
+	if rows != 90 {
+		t.Fatalf("expected 90 rows, got %d", rows)
+	}
+
+	// Values are converted to the affinity of the declared type.
+	if _, err = conn.Exec("insert into foo values('7', 2, 3.5, 'x')", nil); err != nil {
+		t.Fatal("Failed to insert:", err)
+	}
+	err = conn.QueryColumns("select id, f, name from foo where data = 'x'", nil, 0, func(ch *ColumnChunk) error {
+		if ch.Len != 1 || ch.Columns[0].Int64[0] != 7 || ch.Columns[1].Float64[0] != 2 || ch.Columns[2].Text[0] != "3.5" {
+			t.Fatalf("unexpected converted values: %+v", ch.Columns)
+		}
+		return nil
+	})
+	if err != nil {
+		t.Fatal("Failed to query columns:", err)
+	}
+
+	// Columns of NUMERIC affinity take the kind of their values.
+	if _, err = conn.Exec(`create table bar (a STRING, b JSON, c decimal);
+		insert into bar values (null, null, null), ('hello', '{"x":1}', 2.5)`, nil); err != nil {
+		t.Fatal("Failed to create table:", err)
+	}
+	err = conn.QueryColumns("select a, b, c from bar", nil, 0, func(ch *ColumnChunk) error {
+		a, b, c := ch.Columns[0], ch.Columns[1], ch.Columns[2]
+		if a.Kind != ColumnText || b.Kind != ColumnText || c.Kind != ColumnFloat64 {
+			t.Fatalf("expected kinds text, text and float, got %d, %d and %d", a.Kind, b.Kind, c.Kind)
+		}
+		if ch.Len != 2 || !a.IsNull(0) || a.Text[1] != "hello" || b.Text[1] != `{"x":1}` || c.Float64[1] != 2.5 {
+			t.Fatalf("unexpected values: %+v", ch.Columns)
+		}
+		return nil
+	})
+	if err != nil {
+		t.Fatal("Failed to query columns:", err)
+	}
+
+	// A NUMERIC column holding integers and reals is promoted to reals, even
+	// when the first real shows up in a later chunk.
+	if _, err = conn.Exec("create table prices (price numeric); insert into prices values (10), (10.5), (11.25)", nil); err != nil {
+		t.Fatal("Failed to create table:", err)
+	}
+	for _, chunkSize := range []int{0, 1} {
+		var got []float64
+		err = conn.QueryColumns("select price from prices order by rowid", nil, chunkSize, func(ch *ColumnChunk) error {
+			v := ch.Columns[0]
+			if ch.Len == 3 && v.Kind != ColumnFloat64 {
+				t.Fatalf("expected kind real, got %s", v.Kind)
+			}
+			if v.Kind == ColumnFloat64 {
+				got = append(got, v.Float64...)
+			} else {
+				got = append(got, float64(v.Int64[0]))
+			}
+			return nil
+		})
+		if err != nil {
+			t.Fatal("Failed to query columns:", err)
+		}
+		if len(got) != 3 || got[0] != 10 || got[1] != 10.5 || got[2] != 11.25 {
+			t.Fatalf("chunk size %d: unexpected prices %v", chunkSize, got)
+		}
+	}
+
+	// Other mixes of kinds are not converted.
+	for _, chunkSize := range []int{0, 1} {
+		err = conn.QueryColumns("select 1 union all select 'abc' union all select 2.75", nil, chunkSize, func(*ColumnChunk) error { return nil })
+		if err == nil || !strings.Contains(err.Error(), "mixes integer and text") {
+			t.Fatalf("chunk size %d: expected mixed kinds error, got %v", chunkSize, err)
+		}
+	}
+
+	errStop := errors.New("stop")
+	if err = conn.QueryColumns("select id from foo", nil, 10, func(*ColumnChunk) error { return errStop }); err != errStop {
+		t.Fatalf("expected callback error, got %v", err)
+	}
+}
+
+func benchmarkQueryColumnsSetup(b *testing.B) *SQLiteConn {
+	d := SQLiteDriver{}
+	dc, err := d.Open(":memory:")
+	if err != nil {
+		b.Fatal(err)
+	}
+	conn := dc.(*SQLiteConn)
+	_, err = conn.Exec(`create table foo (id integer, f real);
+		with recursive n(i) as (select 0 union all select i + 1 from n where i < 99999)
+		insert into foo select i, i / 3.0 from n`, nil)
+	if err != nil {
+		b.Fatal(err)
+	}
+	return conn
+}
+
+func BenchmarkQueryRowsNumeric(b *testing.B) {
+	conn := benchmarkQueryColumnsSetup(b)
+	defer conn.Close()
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		rows, err := conn.Query("select id, f from foo", nil)
+		if err != nil {
+			b.Fatal(err)
+		}
+		var sum float64
+		dest := make([]driver.Value, 2)
+		for rows.Next(dest) == nil {
+			sum += float64(dest[0].(int64)) + dest[1].(float64)
+		}
+		rows.Close()
+	}
+}
+
+func BenchmarkQueryColumnsNumeric(b *testing.B) {
+	conn := benchmarkQueryColumnsSetup(b)
+	defer conn.Close()
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		var sum float64
+		err := conn.QueryColumns("select id, f from foo", nil, 4096, func(ch *ColumnChunk) error {
+			for r := 0; r < ch.Len; r++ {
+				sum += float64(ch.Columns[0].Int64[r]) + ch.Columns[1].Float64[r]
+			}
+			return nil
+		})
+		if err != nil {
+			b.Fatal(err)
+		}
+	}
+}
+
+func TestParseTimestamp(t *testing.T) {
+	inputs := []string{
+		"2006-01-02 15:04:05.999999999-07:00",
+		"2006-01-02T15:04:05.123+05:30",
+		"2006-01-02 15:04:05+00:00",
+		"2006-01-02 15:04:05-00:00",
+		"2006-01-02 15:04:05.5",
+		"2006-01-02T15:04:05.0000000001",
+		"2006-01-02 15:04:05",
+		"2006-01-02T15:04:05Z",
+		"2006-01-02 15:04",
+		"2006-01-02",
+		"2004-02-29 00:00:00",
+		"2006-02-29 00:00:00",
+		"2006-13-02 15:04:05",
+		"2006-01-02 24:00:00",
+		"2006-01-02 15:04:60",
+		"2006-01-02 15:04:05.",
+		"2006-01-02 15:04:05+25:00",
+		"2006-01-02 15:04:05 +07:00",
+		"2006-01-02 15:04:05+0700",
+		"20060102 150405",
+		"not a time",
+		"",
+	}
+	for _, in := range inputs {
+		var want time.Time
+		var wantErr error
+		s := strings.TrimSuffix(in, "Z")
+		for _, format := range SQLiteTimestampFormats {
+			if want, wantErr = time.ParseInLocation(format, s, time.UTC); wantErr == nil {
+				break
+			}
+		}
+		if wantErr != nil {
+			want = time.Time{}
+		}
+		var d columnDecoder
+		for n := 0; n < 2; n++ {
+			got, err := d.parseTime(in)
+			if (err != nil) != (wantErr != nil) || !reflect.DeepEqual(got, want) {
+				t.Errorf("%q: expected %v (%v), got %v (%v)", in, want, wantErr, got, err)
+			}
+		}
+	}
+}
+
+func BenchmarkQueryTimestamps(b *testing.B) {
+	d := SQLiteDriver{}
+	dc, err := d.Open(":memory:")
+	if err != nil {
+		b.Fatal(err)
+	}
+	conn := dc.(*SQLiteConn)
+	defer conn.Close()
+	if _, err = conn.Exec("create table foo (a timestamp, b datetime)", nil); err != nil {
+		b.Fatal(err)
+	}
+	base := time.Date(2020, 1, 1, 0, 0, 0, 0, time.FixedZone("", 3600))
+	for i := 0; i < 10000; i++ {
+		ts := base.Add(time.Duration(i) * time.Second)
+		args := []driver.Value{ts, ts.UTC().Format("2006-01-02T15:04:05")}
+		if _, err = conn.Exec("insert into foo values(?, ?)", args); err != nil {
+			b.Fatal(err)
+		}
+	}
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		rows, err := conn.Query("select a, b from foo", nil)
+		if err != nil {
+			b.Fatal(err)
+		}
+		dest := make([]driver.Value, 2)
+		for rows.Next(dest) == nil {
+		}
+		rows.Close()
+	}
+}
+
+func TestTimeFormat(t *testing.T) {
+	ts := time.Date(2021, 6, 30, 23, 59, 58, 123456789, time.UTC)
+	for _, tt := range []struct {
+		format string
+		typ    string
+		want   time.Time
+	}{
+		{"text", "text", ts},
+		{"unixnano", "integer", ts},
+		{"unixmilli", "integer", ts.Truncate(time.Millisecond)},
+		{"julianday", "real", ts.Round(time.Millisecond)},
+	} {
+		for _, prefetch := range []int{0, 8} {
+			db, err := sql.Open("sqlite3", fmt.Sprintf("file::memory:?_time_format=%s&_prefetch_rows=%d", tt.format, prefetch))
+			if err != nil {
+				t.Fatal("Failed to open database:", err)
+			}
+			if _, err = db.Exec("create table foo (ts timestamp, d date)"); err != nil {
+				t.Fatal("Failed to create table:", err)
+			}
+			if _, err = db.Exec("insert into foo values(?, ?)", ts, time.Date(2000, 1, 1, 0, 0, 0, 0, time.UTC)); err != nil {
+				t.Fatal("Failed to insert:", err)
+			}
+			var got, day time.Time
+			var typ string
+			if err = db.QueryRow("select ts, d, typeof(ts) from foo").Scan(&got, &day, &typ); err != nil {
+				t.Fatal("Failed to query:", err)
+			}
+			if !got.Equal(tt.want) || typ != tt.typ {
+				t.Errorf("%s: expected %v stored as %s, got %v stored as %s", tt.format, tt.want, tt.typ, got, typ)
+			}
+			// A whole Julian day is stored as INTEGER by NUMERIC affinity.
+			if !day.Equal(time.Date(2000, 1, 1, 0, 0, 0, 0, time.UTC)) {
+				t.Errorf("%s: unexpected date %v", tt.format, day)
+			}
+			db.Close()
+		}
+	}
+	db, _ := sql.Open("sqlite3", "file::memory:?_time_format=bogus")
+	if err := db.Ping(); err == nil {
+		t.Fatal("expected error for invalid _time_format")
+	}
+	db.Close()
+}
+
+func TestTimeFormatRange(t *testing.T) {
+	times := []time.Time{{}, time.Date(2300, 1, 2, 3, 4, 5, 6000000, time.UTC)}
+	for _, format := range []string{"unixmilli", "unixnano"} {
+		d := SQLiteDriver{}
+		dc, err := d.Open("file::memory:?_time_format=" + format)
+		if err != nil {
+			t.Fatal("Failed to open database:", err)
+		}
+		conn := dc.(*SQLiteConn)
+		if _, err = conn.Exec("create table foo (id integer, ts timestamp)", nil); err != nil {
+			t.Fatal("Failed to create table:", err)
+		}
+		ds, err := conn.Prepare("insert into foo values(?, ?)")
+		if err != nil {
+			t.Fatal("Failed to prepare:", err)
+		}
+		stmt := ds.(*SQLiteStmt)
+		for i, ts := range times {
+			_, bindErr := stmt.Exec([]driver.Value{int64(i), ts})
+			_, batchErr := stmt.ExecBatch([][]driver.Value{{int64(i), ts}})
+			if format == "unixnano" {
+				// Both times are out of the range of nanoseconds in an int64.
+				if !errors.Is(bindErr, errUnixNanoRange) || !errors.Is(batchErr, errUnixNanoRange) {
+					t.Fatalf("%s: expected %v for %v, got %v and %v", format, errUnixNanoRange, ts, bindErr, batchErr)
+				}
+				continue
+			}
+			if bindErr != nil || batchErr != nil {
+				t.Fatalf("%s: failed to insert %v: %v, %v", format, ts, bindErr, batchErr)
+			}
+		}
+		stmt.Close()
+
+		rows, err := conn.Query("select id, ts from foo order by id", nil)
+		if err != nil {
+			t.Fatal("Failed to query:", err)
+		}
+		dest := make([]driver.Value, 2)
+		n := 0
+		for rows.Next(dest) == nil {
+			// Each time was inserted twice, bound and through ExecBatch.
+			want := times[dest[0].(int64)]
+			if got, ok := dest[1].(time.Time); !ok || !got.Equal(want) {
+				t.Errorf("%s: expected %v, got %v", format, want, dest[1])
+			}
+			n++
+		}
+		rows.Close()
+		if want := 2 * len(times); format == "unixmilli" && n != want {
+			t.Errorf("%s: expected %d rows, got %d", format, want, n)
+		}
+		conn.Close()
+	}
+}
+
+func benchmarkTimeFormat(b *testing.B, format string, roundTrip bool) {
+	db, err := sql.Open("sqlite3", "file::memory:?_time_format="+format)
+	if err != nil {
+		b.Fatal(err)
+	}
+	defer db.Close()
+	db.SetMaxOpenConns(1)
+	if _, err = db.Exec("create table foo (ts timestamp); create index foo_ts on foo(ts)"); err != nil {
+		b.Fatal(err)
+	}
+	base := time.Date(2021, 1, 1, 0, 0, 0, 0, time.UTC)
+	insert := func(n int) {
+		tx, err := db.Begin()
+		if err != nil {
+			b.Fatal(err)
+		}
+		stmt, err := tx.Prepare("insert into foo values(?)")
+		if err != nil {
+			b.Fatal(err)
+		}
+		for i := 0; i < n; i++ {
+			if _, err = stmt.Exec(base.Add(time.Duration(i) * time.Millisecond)); err != nil {
+				b.Fatal(err)
+			}
+		}
+		stmt.Close()
+		if err = tx.Commit(); err != nil {
+			b.Fatal(err)
+		}
+	}
+	if !roundTrip {
+		// Storage size per row, table and index included.
+		insert(10000)
+		var pages, size int64
+		db.QueryRow("pragma page_count").Scan(&pages)
+		db.QueryRow("pragma page_size").Scan(&size)
+		b.ReportMetric(float64(pages*size)/10000, "bytes/row")
+		b.ReportMetric(0, "ns/op")
+		return
+	}
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		insert(1000)
+		rows, err := db.Query("select ts from foo")
+		if err != nil {
+			b.Fatal(err)
+		}
+		var ts time.Time
+		for rows.Next() {
+			if err = rows.Scan(&ts); err != nil {
+				b.Fatal(err)
+			}
+		}
+		rows.Close()
+		if _, err = db.Exec("delete from foo"); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
+
+func BenchmarkTimeFormatText(b *testing.B)          { benchmarkTimeFormat(b, "text", true) }
+func BenchmarkTimeFormatUnixNano(b *testing.B)      { benchmarkTimeFormat(b, "unixnano", true) }
+func BenchmarkTimeFormatJulianDay(b *testing.B)     { benchmarkTimeFormat(b, "julianday", true) }
+func BenchmarkTimeFormatTextSize(b *testing.B)      { benchmarkTimeFormat(b, "text", false) }
+func BenchmarkTimeFormatUnixNanoSize(b *testing.B)  { benchmarkTimeFormat(b, "unixnano", false) }
+func BenchmarkTimeFormatUnixMilliSize(b *testing.B) { benchmarkTimeFormat(b, "unixmilli", false) }
+func BenchmarkTimeFormatJulianDaySize(b *testing.B) { benchmarkTimeFormat(b, "julianday", false) }
+
+func TestRWPool(t *testing.T) {
+	var opened int32
+	sql.Register("sqlite3_TestRWPool", &SQLiteDriver{
+		ConnectHook: func(c *SQLiteConn) error {
+			atomic.AddInt32(&opened, 1)
+			return nil
+		},
+	})
+	tempFilename := TempFilename(t)
+	defer os.Remove(tempFilename)
+	db, err := sql.Open("sqlite3_TestRWPool", "file:"+tempFilename+"?_pool=rw&_readers=3&_journal_mode=WAL&_stmt_cache=8")
+	if err != nil {
+		t.Fatal("Failed to open database:", err)
+	}
+	defer db.Close()
+
+	if _, err = db.Exec("create table foo (id integer primary key, name text)"); err != nil {
+		t.Fatal("Failed to create table:", err)
+	}
+	ins, err := db.Prepare("insert into foo(name) values(?)")
+	if err != nil {
+		t.Fatal("Failed to prepare:", err)
+	}
+	defer ins.Close()
+
+	var wg sync.WaitGroup
+	errs := make(chan error, 16)
+	for g := 0; g < 16; g++ {
+		wg.Add(1)
+		go func(g int) {
+			defer wg.Done()
+			for i := 0; i < 25; i++ {
+				if _, err := ins.Exec(fmt.Sprintf("g%d-%d", g, i)); err != nil {
+					errs <- err
+					return
+				}
+				var n int
+				if err := db.QueryRow("select count(*) from foo where name like ?", fmt.Sprintf("g%d-%%", g)).Scan(&n); err != nil || n != i+1 {
+					errs <- fmt.Errorf("expected %d rows, got %d (%v)", i+1, n, err)
+					return
+				}
+			}
+		}(g)
+	}
+	wg.Wait()
+	close(errs)
+	for err := range errs {
+		t.Fatal(err)
+	}
+	if n := atomic.LoadInt32(&opened); n > 4 {
+		t.Fatalf("expected at most 1 writer and 3 readers, got %d connections", n)
+	}
+
+	// A read-only transaction runs on a query_only reader.
+	tx, err := db.BeginTx(context.Background(), &sql.TxOptions{ReadOnly: true})
+	if err != nil {
+		t.Fatal("Failed to begin:", err)
+	}
+	if _, err = tx.Exec("insert into foo(name) values('ro')"); err == nil {
+		t.Fatal("expected insert in a read-only transaction to fail")
+	}
+	tx.Rollback()
+
+	// Statements a reader cannot prepare run on the writer.
+	conn, err := db.Conn(context.Background())
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer conn.Close()
+	if _, err = conn.ExecContext(context.Background(), "create temp table bar as select 42 as v"); err != nil {
+		t.Fatal("Failed to create temp table:", err)
+	}
+	var v int
+	if err = conn.QueryRowContext(context.Background(), "select v from bar").Scan(&v); err != nil || v != 42 {
+		t.Fatalf("expected 42 from temp table, got %d (%v)", v, err)
+	}
+
+	var count int
+	if err = db.QueryRow("select count(*) from foo").Scan(&count); err != nil || count != 400 {
+		t.Fatalf("expected 400 rows, got %d (%v)", count, err)
+	}
+
+	bad, _ := sql.Open("sqlite3", "file:"+tempFilename+"?_pool=bogus")
+	if err = bad.Ping(); err == nil {
+		t.Fatal("expected error for invalid _pool")
+	}
+	bad.Close()
+}
+
+func TestRWPoolBusy(t *testing.T) {
+	tempFilename := TempFilename(t)
+	defer os.Remove(tempFilename)
+	db, err := sql.Open("sqlite3", "file:"+tempFilename+"?_pool=rw&_journal_mode=WAL&_busy_timeout=100")
+	if err != nil {
+		t.Fatal("Failed to open database:", err)
+	}
+	defer db.Close()
+	if _, err = db.Exec("create table foo (id integer primary key)"); err != nil {
+		t.Fatal("Failed to create table:", err)
+	}
+
+	// The transaction holds the writer, so the insert gives up after the
+	// busy timeout rather than waiting for it forever.
+	tx, err := db.Begin()
+	if err != nil {
+		t.Fatal("Failed to begin:", err)
+	}
+	start := time.Now()
+	_, err = db.Exec("insert into foo values (1)")
+	if sqliteErr, ok := err.(Error); !ok || sqliteErr.Code != ErrBusy {
+		t.Fatalf("expected ErrBusy, got %v", err)
+	}
+	if elapsed := time.Since(start); elapsed < 100*time.Millisecond {
+		t.Fatalf("expected to wait for the busy timeout, gave up after %v", elapsed)
+	}
+	if err = tx.Rollback(); err != nil {
+		t.Fatal("Failed to rollback:", err)
+	}
+	if _, err = db.Exec("insert into foo values (1)"); err != nil {
+		t.Fatal("Failed to insert:", err)
+	}
+}
+
+func benchmarkRWPool(b *testing.B, params string) {
+	tempFilename := TempFilename(b)
+	defer os.Remove(tempFilename)
+	db, err := sql.Open("sqlite3", "file:"+tempFilename+"?_journal_mode=WAL&_stmt_cache=8"+params)
+	if err != nil {
+		b.Fatal(err)
+	}
+	defer db.Close()
+	if _, err = db.Exec("create table foo (id integer primary key, name text)"); err != nil {
+		b.Fatal(err)
+	}
+	for i := 0; i < 1000; i++ {
+		if _, err = db.Exec("insert into foo(name) values(?)", fmt.Sprint(i)); err != nil {
+			b.Fatal(err)
+		}
+	}
+	var n int64
+	b.SetParallelism(4)
+	b.ResetTimer()
+	b.RunParallel(func(pb *testing.PB) {
+		for pb.Next() {
+			i := atomic.AddInt64(&n, 1)
+			if i%10 == 0 {
+				if _, err := db.Exec("insert into foo(name) values(?)", fmt.Sprint(i)); err != nil {
+					b.Error(err)
+					return
+				}
+				continue
+			}
+			var name string
+			if err := db.QueryRow("select name from foo where id = ?", i%1000+1).Scan(&name); err != nil {
+				b.Error(err)
+				return
+			}
+		}
+	})
+}
+
+func BenchmarkPoolDefault(b *testing.B) { benchmarkRWPool(b, "") }
+func BenchmarkPoolRW(b *testing.B)      { benchmarkRWPool(b, "&_pool=rw") }
+
+func TestGroupCommit(t *testing.T) {
+	tempFilename := TempFilename(t)
+	defer os.Remove(tempFilename)
+	db, err := sql.Open("sqlite3", "file:"+tempFilename+"?_pool=rw&_journal_mode=WAL&_group_commit=16&_group_commit_delay=1ms")
+	if err != nil {
+		t.Fatal("Failed to open database:", err)
+	}
+	defer db.Close()
+	if _, err = db.Exec("create table foo (id integer primary key, name text unique)"); err != nil {
+		t.Fatal("Failed to create table:", err)
+	}
+
+	var wg sync.WaitGroup
+	errs := make(chan error, 32)
+	for g := 0; g < 32; g++ {
+		wg.Add(1)
+		go func(g int) {
+			defer wg.Done()
+			for i := 0; i < 10; i++ {
+				name := fmt.Sprintf("g%d-%d", g, i)
+				res, err := db.Exec("insert into foo(name) values(?)", name)
+				if err != nil {
+					errs <- err
+					return
+				}
+				id, _ := res.LastInsertId()
+				var got string
+				if err = db.QueryRow("select name from foo where id = ?", id).Scan(&got); err != nil || got != name {
+					errs <- fmt.Errorf("row %d: expected %q, got %q (%v)", id, name, got, err)
+					return
+				}
+				// A failing statement only fails its own caller.
+				if _, err = db.Exec("insert into foo(name) values(?)", name); err == nil {
+					errs <- fmt.Errorf("expected unique constraint error for %q", name)
+					return
+				}
+			}
+		}(g)
+	}
+	wg.Wait()
+	close(errs)
+	for err := range errs {
+		t.Fatal(err)
+	}
+	var count int
+	if err = db.QueryRow("select count(*) from foo").Scan(&count); err != nil || count != 320 {
+		t.Fatalf("expected 320 rows, got %d (%v)", count, err)
+	}
+
+	// Explicit transactions bypass the queue.
+	tx, err := db.Begin()
+	if err != nil {
+		t.Fatal("Failed to begin:", err)
+	}
+	if _, err = tx.Exec("delete from foo"); err != nil {
+		t.Fatal("Failed to delete:", err)
+	}
+	if err = tx.Rollback(); err != nil {
+		t.Fatal("Failed to rollback:", err)
+	}
+	if err = db.QueryRow("select count(*) from foo").Scan(&count); err != nil || count != 320 {
+		t.Fatalf("expected 320 rows after rollback, got %d (%v)", count, err)
+	}
+}
+
+func TestGroupCommitContext(t *testing.T) {
+	tempFilename := TempFilename(t)
+	defer os.Remove(tempFilename)
+	db, err := sql.Open("sqlite3", "file:"+tempFilename+"?_pool=rw&_journal_mode=WAL&_group_commit=16")
+	if err != nil {
+		t.Fatal("Failed to open database:", err)
+	}
+	defer db.Close()
+	if _, err = db.Exec("create table foo (id integer primary key)"); err != nil {
+		t.Fatal("Failed to create table:", err)
+	}
+
+	// The queued insert waits for the writer held by the transaction; it
+	// returns when its context is done and is then skipped.
+	tx, err := db.Begin()
+	if err != nil {
+		t.Fatal("Failed to begin:", err)
+	}
+	ctx, cancel := context.WithTimeout(context.Background(), 50*time.Millisecond)
+	defer cancel()
+	if _, err = db.ExecContext(ctx, "insert into foo values (1)"); err != context.DeadlineExceeded {
+		t.Fatalf("expected %v, got %v", context.DeadlineExceeded, err)
+	}
+	if err = tx.Rollback(); err != nil {
+		t.Fatal("Failed to rollback:", err)
+	}
+	if _, err = db.Exec("insert into foo values (2)"); err != nil {
+		t.Fatal("Failed to insert:", err)
+	}
+	var count int
+	if err = db.QueryRow("select count(*) from foo").Scan(&count); err != nil || count != 1 {
+		t.Fatalf("expected 1 row, got %d (%v)", count, err)
+	}
+}
+
+func TestGroupCommitRunning(t *testing.T) {
+	started := make(chan struct{}, 1)
+	release := make(chan struct{})
+	sql.Register("sqlite3_GroupCommitRunning", &SQLiteDriver{
+		ConnectHook: func(conn *SQLiteConn) error {
+			return conn.RegisterFunc("block", func() int64 {
+				started <- struct{}{}
+				<-release
+				return 1
+			}, false)
+		},
+	})
+	tempFilename := TempFilename(t)
+	defer os.Remove(tempFilename)
+	db, err := sql.Open("sqlite3_GroupCommitRunning", "file:"+tempFilename+"?_pool=rw&_journal_mode=WAL&_group_commit=16")
+	if err != nil {
+		t.Fatal("Failed to open database:", err)
+	}
+	defer db.Close()
+	if _, err = db.Exec("create table foo (id integer primary key)"); err != nil {
+		t.Fatal("Failed to create table:", err)
+	}
+
+	// A context done while the insert runs does not hide that it committed:
+	// the caller keeps waiting for the result.
+	ctx, cancel := context.WithCancel(context.Background())
+	defer cancel()
+	errc := make(chan error, 1)
+	go func() {
+		_, err := db.ExecContext(ctx, "insert into foo values (block())")
+		errc <- err
+	}()
+	<-started
+	cancel()
+	early := false
+	select {
+	case err = <-errc:
+		early = true
+	case <-time.After(50 * time.Millisecond):
+	}
+	close(release)
+	if early {
+		t.Fatalf("expected the running insert to wait for its result, got %v", err)
+	}
+	if err = <-errc; err != nil {
+		t.Fatal("Failed to insert:", err)
+	}
+	var count int
+	if err = db.QueryRow("select count(*) from foo").Scan(&count); err != nil || count != 1 {
+		t.Fatalf("expected 1 row, got %d (%v)", count, err)
+	}
+}
+
+func benchmarkGroupCommit(b *testing.B, params string) {
+	tempFilename := TempFilename(b)
+	defer os.Remove(tempFilename)
+	db, err := sql.Open("sqlite3", "file:"+tempFilename+"?_pool=rw&_journal_mode=WAL&_sync=FULL"+params)
+	if err != nil {
+		b.Fatal(err)
+	}
+	defer db.Close()
+	if _, err = db.Exec("create table foo (id integer primary key, v integer)"); err != nil {
+		b.Fatal(err)
+	}
+	b.SetParallelism(200)
+	b.ResetTimer()
+	b.RunParallel(func(pb *testing.PB) {
+		for pb.Next() {
+			if _, err := db.Exec("insert into foo(v) values(?)", 1); err != nil {
+				b.Error(err)
+				return
+			}
+		}
+	})
+}
+
+func BenchmarkExecPerCommit(b *testing.B)   { benchmarkGroupCommit(b, "") }
+func BenchmarkExecGroupCommit(b *testing.B) { benchmarkGroupCommit(b, "&_group_commit=256") }
+
+func TestStats(t *testing.T) {
+	d := &SQLiteDriver{}
+	sql.Register("sqlite3_TestStats", d)
+	tempFilename := TempFilename(t)
+	defer os.Remove(tempFilename)
+	db, err := sql.Open("sqlite3_TestStats", tempFilename)
+	if err != nil {
+		t.Fatal("Failed to open database:", err)
+	}
+	defer db.Close()
+	db.SetMaxOpenConns(1)
+	if _, err = db.Exec("create table foo (id integer primary key, v integer)"); err != nil {
+		t.Fatal("Failed to create table:", err)
+	}
+	for i := 0; i < 100; i++ {
+		if _, err = db.Exec("insert into foo(v) values(?)", i%7); err != nil {
+			t.Fatal("Failed to insert:", err)
+		}
+	}
+
+	conn, err := db.Conn(context.Background())
+	if err != nil {
+		t.Fatal(err)
+	}
+	err = conn.Raw(func(driverConn interface{}) error {
+		c := driverConn.(*SQLiteConn)
+		s, err := c.Prepare("select v, count(*) from foo where v > 0 group by v order by 2")
+		if err != nil {
+			return err
+		}
+		defer s.Close()
+		for i := 0; i < 2; i++ {
+			rows, err := s.Query(nil)
+			if err != nil {
+				return err
+			}
+			dest := make([]driver.Value, 2)
+			for rows.Next(dest) == nil {
+			}
+			rows.Close()
+		}
+		st := s.(*SQLiteStmt).Stats()
+		if st.Runs != 2 || st.FullscanSteps < 2*99 || st.Sorts == 0 || st.VMSteps == 0 || st.MemoryUsed == 0 {
+			t.Errorf("unexpected statement stats: %+v", st)
+		}
+
+		cs, err := c.Stats()
+		if err != nil {
+			return err
+		}
+		if cs.CacheHit == 0 || cs.CacheWrite == 0 || cs.SchemaUsed == 0 || cs.StmtUsed == 0 {
+			t.Errorf("unexpected connection stats: %+v", cs)
+		}
+		return nil
+	})
+	if err != nil {
+		t.Fatal(err)
+	}
+	conn.Close()
+
+	ds := d.Stats()
+	if ds.OpenConns != 1 || ds.CacheHit == 0 || ds.SchemaUsed == 0 {
+		t.Errorf("unexpected driver stats: %+v", ds)
+	}
+	db.Close()
+	closed := d.Stats()
+	if closed.OpenConns != 0 || closed.CacheHit < ds.CacheHit || closed.CacheWrite < ds.CacheWrite || closed.SchemaUsed != 0 {
+		t.Errorf("unexpected driver stats after close: %+v, was %+v", closed, ds)
+	}
+}
+
+func TestQueryPlan(t *testing.T) {
+	db, err := sql.Open("sqlite3", ":memory:")
+	if err != nil {
+		t.Fatal("Failed to open database:", err)
+	}
+	defer db.Close()
+	db.SetMaxOpenConns(1)
+	if _, err = db.Exec("create table foo (id integer primary key, v integer); create index foo_v on foo(v)"); err != nil {
+		t.Fatal("Failed to create table:", err)
+	}
+	conn, err := db.Conn(context.Background())
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer conn.Close()
+	err = conn.Raw(func(driverConn interface{}) error {
+		s, err := driverConn.(*SQLiteConn).Prepare("select * from foo where v = ? union all select * from foo where id > ?")
+		if err != nil {
+			return err
+		}
+		defer s.Close()
+		plan, err := s.(*SQLiteStmt).QueryPlan()
+		if err != nil {
+			return err
+		}
+		var details []string
+		for _, row := range plan {
+			details = append(details, row.Detail)
+		}
+		all := strings.Join(details, "\n")
+		if !strings.Contains(all, "INDEX foo_v") || !strings.Contains(all, "INTEGER PRIMARY KEY") {
+			t.Errorf("unexpected plan:\n%s", all)
+		}
+		nested := false
+		for _, row := range plan {
+			nested = nested || row.Parent != 0
+		}
+		if !nested {
+			t.Errorf("expected nested plan rows: %+v", plan)
+		}
+		return nil
+	})
+	if err != nil {
+		t.Fatal(err)
+	}
+}
+
+func TestSoftHeapLimit(t *testing.T) {
+	const (
+		conns = 64
+		limit = 4 << 20
+	)
+	d := &SQLiteDriver{}
+	sql.Register("sqlite3_TestSoftHeapLimit", d)
+	tempFilename := TempFilename(t)
+	defer os.Remove(tempFilename)
+	db, err := sql.Open("sqlite3_TestSoftHeapLimit", tempFilename+"?_journal_mode=WAL&_soft_heap_limit=4194304")
+	if err != nil {
+		t.Fatal("Failed to open database:", err)
+	}
+	defer db.Close()
+	defer SetSoftHeapLimit(0)
+	db.SetMaxOpenConns(conns)
+	db.SetMaxIdleConns(conns)
+	if _, err = db.Exec("create table foo (id integer primary key, data blob)"); err != nil {
+		t.Fatal("Failed to create table:", err)
+	}
+	// 2MB of data: without the limit every connection would cache all of it.
+	if _, err = db.Exec("with recursive n(i) as (select 1 union all select i+1 from n where i < 512) insert into foo(data) select randomblob(4000) from n"); err != nil {
+		t.Fatal("Failed to insert:", err)
+	}
+	if got := SetSoftHeapLimit(-1); got != limit {
+		t.Fatalf("soft heap limit: want %d, got %d", limit, got)
+	}
+	MemoryStatus(true)
+
+	var wg sync.WaitGroup
+	var peak int64
+	stop := make(chan struct{})
+	go func() {
+		for {
+			if used := d.Stats().CacheUsed; used > atomic.LoadInt64(&peak) {
+				atomic.StoreInt64(&peak, used)
+			}
+			select {
+			case <-stop:
+				return
+			case <-time.After(time.Millisecond):
+			}
+		}
+	}()
+	start := make(chan struct{})
+	errs := make(chan error, conns)
+	for i := 0; i < conns; i++ {
+		wg.Add(1)
+		go func() {
+			defer wg.Done()
+			conn, err := db.Conn(context.Background())
+			if err != nil {
+				errs <- err
+				return
+			}
+			defer conn.Close()
+			if _, err = conn.ExecContext(context.Background(), "pragma cache_size = -65536"); err != nil {
+				errs <- err
+				return
+			}
+			<-start
+			var n int64
+			for j := 0; j < 3; j++ {
+				if err := conn.QueryRowContext(context.Background(), "select sum(length(data)) from foo").Scan(&n); err != nil {
+					errs <- err
+					return
+				}
+			}
+		}()
+	}
+	close(start)
+	wg.Wait()
+	close(stop)
+	close(errs)
+	for err := range errs {
+		t.Fatal(err)
+	}
+
+	// Every cache keeps the few pages it holds while reading.
+	if used := d.Stats().CacheUsed; used > atomic.LoadInt64(&peak) {
+		peak = used
+	}
+	if max := int64(limit + conns*64<<10); peak > max {
+		t.Fatalf("page cache memory %d exceeds %d", peak, max)
+	}
+	ms := MemoryStatus(false)
+	if ms.MemoryUsed <= 0 || ms.MemoryUsedHighwater < ms.MemoryUsed || ms.MallocCount <= 0 {
+		t.Fatalf("unexpected memory status: %+v", ms)
+	}
+	t.Logf("peak page cache %d bytes, memory highwater %d bytes", peak, ms.MemoryUsedHighwater)
+}
+
+func TestLookaside(t *testing.T) {
+	stats := func(dsn string) ConnStats {
+		d := SQLiteDriver{}
+		conn, err := d.Open(dsn)
+		if err != nil {
+			t.Fatal(err)
+		}
+		defer conn.Close()
+		c := conn.(*SQLiteConn)
+		if _, err = c.Exec("create table foo (id integer primary key, v text); insert into foo(v) values('a'), ('b')", nil); err != nil {
+			t.Fatal(err)
+		}
+		for i := 0; i < 10; i++ {
+			rows, err := c.Query("select * from foo where v = ?", []driver.Value{"a"})
+			if err != nil {
+				t.Fatal(err)
+			}
+			dest := make([]driver.Value, 2)
+			for rows.Next(dest) == nil {
+			}
+			rows.Close()
+		}
+		s, err := c.Stats()
+		if err != nil {
+			t.Fatal(err)
+		}
+		return s
+	}
+	d := SQLiteDriver{}
+	if !compileOptionUsed(t, "OMIT_LOOKASIDE") {
+		if s := stats(":memory:?_lookaside=512,256"); s.LookasideHit == 0 {
+			t.Fatalf("expected lookaside hits: %+v", s)
+		}
+		if s := stats(":memory:?_lookaside=0,0"); s.LookasideHit != 0 || s.LookasideUsed != 0 {
+			t.Fatalf("expected lookaside to be disabled: %+v", s)
+		}
+	} else if _, err := d.Open(":memory:?_lookaside=512,256"); err != nil {
+		t.Fatal(err)
+	}
+
+	for _, dsn := range []string{":memory:?_lookaside=512", ":memory:?_lookaside=a,1", ":memory:?_pagecache=4096,-1"} {
+		if _, err := d.Open(dsn); err == nil || !strings.Contains(err.Error(), "expecting size,count") {
+			t.Fatalf("%s: expected invalid value error, got %v", dsn, err)
+		}
+	}
+	// SQLite has been initialized by the connections above.
+	if err := ConfigLookaside(512, 256); err == nil {
+		t.Fatal("expected ConfigLookaside to fail after initialization")
+	}
+	if err := ConfigPageCache(4096, 1000); err == nil {
+		t.Fatal("expected ConfigPageCache to fail after initialization")
+	}
+	if _, err := d.Open(":memory:?_pagecache=4096,1000"); err == nil {
+		t.Fatal("expected _pagecache to fail after initialization")
+	}
+}
+
+// TestAllocatorWithHeapLimit opens the first connection of a new process,
+// as the allocators can only be configured before SQLite is initialized.
+func TestAllocatorWithHeapLimit(t *testing.T) {
+	const dsn = ":memory:?_soft_heap_limit=8000000&_pagecache=4096,100&_lookaside=512,64"
+	if os.Getenv("GO_SQLITE3_FIRST_CONN") == "1" {
+		defer SetSoftHeapLimit(0)
+		d := SQLiteDriver{}
+		conn, err := d.Open(dsn)
+		if err != nil {
+			t.Fatal(err)
+		}
+		defer conn.Close()
+		if _, err = conn.(*SQLiteConn).Exec("create table foo (id integer primary key, v text); insert into foo(v) values('a')", nil); err != nil {
+			t.Fatal(err)
+		}
+		// The page cache settings are in effect: SQLite rejects them now
+		// unless they are repeated.
+		if err = ConfigPageCache(4096, 100); err != nil {
+			t.Fatal(err)
+		}
+		if err = ConfigPageCache(4096, 200); err == nil {
+			t.Fatal("expected ConfigPageCache to fail after initialization")
+		}
+		if got := SetSoftHeapLimit(-1); got != 8000000 {
+			t.Fatalf("soft heap limit: want 8000000, got %d", got)
+		}
+		return
+	}
+	if testing.Short() {
+		t.Skip("skipping the test in a new process in short mode")
+	}
+	cmd := exec.Command(os.Args[0], "-test.run=^TestAllocatorWithHeapLimit$")
+	cmd.Env = append(os.Environ(), "GO_SQLITE3_FIRST_CONN=1")
+	if out, err := cmd.CombinedOutput(); err != nil {
+		t.Fatalf("%s: %v\n%s", dsn, err, out)
+	}
+}
+
+func compileOptionUsed(t testing.TB, option string) bool {
+	db, err := sql.Open("sqlite3", ":memory:")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer db.Close()
+	var used bool
+	if err = db.QueryRow("select sqlite_compileoption_used(?)", option).Scan(&used); err != nil {
+		t.Fatal(err)
+	}
+	return used
+}
+
+func benchmarkLookaside(b *testing.B, params string) {
+	d := SQLiteDriver{}
+	conn, err := d.Open(":memory:" + params)
+	if err != nil {
+		b.Fatal(err)
+	}
+	defer conn.Close()
+	c := conn.(*SQLiteConn)
+	if _, err = c.Exec("create table foo (id integer primary key, name text, v real)", nil); err != nil {
+		b.Fatal(err)
+	}
+	for i := 0; i < 100; i++ {
+		if _, err = c.Exec("insert into foo(name, v) values(?, ?)", []driver.Value{fmt.Sprint("name", i), float64(i)}); err != nil {
+			b.Fatal(err)
+		}
+	}
+	s, err := c.Prepare("select name, v from foo where id between ? and ? order by v desc")
+	if err != nil {
+		b.Fatal(err)
+	}
+	defer s.Close()
+	dest := make([]driver.Value, 2)
+	before, _ := c.Stats()
+	b.ReportAllocs()
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		rows, err := s.Query([]driver.Value{int64(i % 90), int64(i%90 + 10)})
+		if err != nil {
+			b.Fatal(err)
+		}
+		for rows.Next(dest) == nil {
+		}
+		rows.Close()
+	}
+	b.StopTimer()
+	after, _ := c.Stats()
+	b.ReportMetric(float64(after.LookasideHit-before.LookasideHit)/float64(b.N), "lookaside-hits/op")
+	b.ReportMetric(float64(after.LookasideMissSize+after.LookasideMissFull-before.LookasideMissSize-before.LookasideMissFull)/float64(b.N), "lookaside-misses/op")
+}
+
+func BenchmarkLookasideDisabled(b *testing.B) { benchmarkLookaside(b, "?_lookaside=0,0") }
+func BenchmarkLookasideDefault(b *testing.B)  { benchmarkLookaside(b, "") }
+func BenchmarkLookasideSmall(b *testing.B)    { benchmarkLookaside(b, "?_lookaside=128,64") }
+func BenchmarkLookasideLarge(b *testing.B)    { benchmarkLookaside(b, "?_lookaside=512,1024") }
+
+func TestMmapSize(t *testing.T) {
+	tempFilename := TempFilename(t)
+	defer os.Remove(tempFilename)
+	d := SQLiteDriver{}
+	conn, err := d.Open(tempFilename + "?_mmap_size=1048576")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer conn.Close()
+	c := conn.(*SQLiteConn)
+
+	pragma := func() int64 {
+		rows, err := c.Query("PRAGMA mmap_size", nil)
+		if err != nil {
+			t.Fatal(err)
+		}
+		defer rows.Close()
+		dest := make([]driver.Value, 1)
+		if err = rows.Next(dest); err != nil {
+			t.Fatal(err)
+		}
+		return dest[0].(int64)
+	}
+	if got := pragma(); got != 1<<20 {
+		t.Fatalf("mmap_size: want %d, got %d", 1<<20, got)
+	}
+
+	if got, err := c.SetMmapSize(2 << 20); err != nil || got != 2<<20 {
+		t.Fatalf("SetMmapSize: want %d, got %d, %v", 2<<20, got, err)
+	}
+	// The file control reports the previous limit of the file.
+	if prev, err := c.SetFileControlInt64("", SQLITE_FCNTL_MMAP_SIZE, 4<<20); err != nil || prev != 2<<20 {
+		t.Fatalf("SetFileControlInt64: want %d, got %d, %v", 2<<20, prev, err)
+	}
+	if prev, err := c.SetFileControlInt64("", SQLITE_FCNTL_MMAP_SIZE, -1); err != nil || prev != 4<<20 {
+		t.Fatalf("SetFileControlInt64: want %d, got %d, %v", 4<<20, prev, err)
+	}
+	if err := c.SetFileControlInt("", SQLITE_FCNTL_MMAP_SIZE, 1<<20); err != nil {
+		t.Fatal(err)
+	}
+	if prev, err := c.SetFileControlInt64("", SQLITE_FCNTL_MMAP_SIZE, -1); err != nil || prev != 1<<20 {
+		t.Fatalf("SetFileControlInt: want %d, got %d, %v", 1<<20, prev, err)
+	}
+
+	if _, err := d.Open(tempFilename + "?_mmap_size=-1"); err == nil {
+		t.Fatal("expected an error for a negative _mmap_size")
+	}
+}
+
+func benchmarkMmap(b *testing.B, mmapSize int, query string, arg func(i int) int) {
+	tempFilename := TempFilename(b)
+	defer os.Remove(tempFilename)
+	db, err := sql.Open("sqlite3", fmt.Sprintf("%s?_mmap_size=%d&_cache_size=-256", tempFilename, mmapSize))
+	if err != nil {
+		b.Fatal(err)
+	}
+	defer db.Close()
+	db.SetMaxOpenConns(1)
+	if _, err = db.Exec("create table foo (id integer primary key, data blob)"); err != nil {
+		b.Fatal(err)
+	}
+	// About 20MB, far more than the 256KB page cache.
+	if _, err = db.Exec("with recursive n(i) as (select 1 union all select i+1 from n where i < 100000) insert into foo(data) select randomblob(200) from n"); err != nil {
+		b.Fatal(err)
+	}
+	s, err := db.Prepare(query)
+	if err != nil {
+		b.Fatal(err)
+	}
+	defer s.Close()
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		var n int64
+		if err := s.QueryRow(arg(i)).Scan(&n); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
+
+func pointLookupArg(i int) int { return (i*7919)%100000 + 1 }
+func rangeScanArg(i int) int   { return (i * 7919) % 99000 }
+
+const (
+	pointLookupQuery = "select length(data) from foo where id = ?"
+	rangeScanQuery   = "select sum(length(data)) from foo where id between ?1 and ?1 + 1000"
+)
+
+func BenchmarkPointLookupPread(b *testing.B) { benchmarkMmap(b, 0, pointLookupQuery, pointLookupArg) }
+func BenchmarkPointLookupMmap(b *testing.B)  { benchmarkMmap(b, 1<<30, pointLookupQuery, pointLookupArg) }
+func BenchmarkRangeScanPread(b *testing.B)   { benchmarkMmap(b, 0, rangeScanQuery, rangeScanArg) }
+func BenchmarkRangeScanMmap(b *testing.B)    { benchmarkMmap(b, 1<<30, rangeScanQuery, rangeScanArg) }
+
+func TestBackgroundCheckpoint(t *testing.T) {
+	var conn *SQLiteConn
+	sql.Register("sqlite3_TestBackgroundCheckpoint", &SQLiteDriver{
+		ConnectHook: func(c *SQLiteConn) error {
+			conn = c
+			return nil
+		},
+	})
+	tempFilename := TempFilename(t)
+	defer os.Remove(tempFilename)
+	db, err := sql.Open("sqlite3_TestBackgroundCheckpoint", tempFilename+"?_journal_mode=WAL&_bg_checkpoint=20")
+	if err != nil {
+		t.Fatal("Failed to open database:", err)
+	}
+	defer db.Close()
+	db.SetMaxOpenConns(1)
+	if _, err = db.Exec("create table foo (id integer primary key, data blob)"); err != nil {
+		t.Fatal("Failed to create table:", err)
+	}
+	for i := 0; i < 200; i++ {
+		if _, err = db.Exec("insert into foo(data) values(randomblob(4000))"); err != nil {
+			t.Fatal("Failed to insert:", err)
+		}
+	}
+	// The inline automatic checkpoint is disabled, so the WAL only restarts
+	// through the checkpointer, which may not have run during the inserts
+	// on a single CPU. Once it has caught up, a commit restarts the WAL.
+	deadline := time.Now().Add(5 * time.Second)
+	var stats CheckpointStats
+	for time.Now().Before(deadline) {
+		if _, err = db.Exec("insert into foo(data) values(randomblob(100))"); err != nil {
+			t.Fatal("Failed to insert:", err)
+		}
+		stats = conn.CheckpointStats()
+		if stats.Restarts+stats.Truncates > 0 && stats.WALFrames < 4*20 {
+			break
+		}
+		time.Sleep(10 * time.Millisecond)
+	}
+	if stats.Checkpoints == 0 || stats.Frames == 0 || stats.TotalDuration <= 0 || stats.Restarts+stats.Truncates == 0 {
+		t.Fatalf("expected background checkpoints restarting the WAL, got %+v", stats)
+	}
+	if stats.WALFrames >= 4*20 {
+		t.Fatalf("expected the WAL to be restarted below 4 times the threshold, got %+v", stats)
+	}
+
+	// The connections to a file share one threshold.
+	d := SQLiteDriver{}
+	if _, err := d.Open(tempFilename + "?_journal_mode=WAL&_bg_checkpoint=30"); err == nil || !strings.Contains(err.Error(), "conflicts") {
+		t.Fatalf("expected a conflicting _bg_checkpoint to fail, got %v", err)
+	}
+}
+
+func TestBackgroundCheckpointOpenError(t *testing.T) {
+	tempFilename := TempFilename(t)
+	defer os.Remove(tempFilename)
+	// The exclusive lock keeps the checkpointer from opening its connection,
+	// so the committing connection checkpoints inline.
+	d := SQLiteDriver{}
+	dc, err := d.Open("file:" + tempFilename + "?_journal_mode=WAL&_locking_mode=EXCLUSIVE&_bg_checkpoint=20")
+	if err != nil {
+		t.Fatal("Failed to open database:", err)
+	}
+	conn := dc.(*SQLiteConn)
+	defer conn.Close()
+	if _, err = conn.Exec("create table foo (id integer primary key, data blob)", nil); err != nil {
+		t.Fatal("Failed to create table:", err)
+	}
+	insert := func() {
+		if _, err := conn.Exec("insert into foo(data) values(randomblob(4000))", nil); err != nil {
+			t.Fatal("Failed to insert:", err)
+		}
+	}
+	deadline := time.Now().Add(5 * time.Second)
+	var stats CheckpointStats
+	for stats.OpenErrors == 0 && time.Now().Before(deadline) {
+		insert()
+		stats = conn.CheckpointStats()
+	}
+	if stats.OpenErrors == 0 || stats.Err == nil {
+		t.Fatalf("expected the checkpointer to fail to open, got %+v", stats)
+	}
+	for i := 0; i < 100; i++ {
+		insert()
+	}
+	stats = conn.CheckpointStats()
+	if stats.WALFrames >= 2*20 {
+		t.Fatalf("expected inline checkpoints to restart the WAL, got %+v", stats)
+	}
+}
+
+func benchmarkWALCommit(b *testing.B, params string) {
+	tempFilename := TempFilename(b)
+	defer os.Remove(tempFilename)
+	db, err := sql.Open("sqlite3", tempFilename+"?_journal_mode=WAL"+params)
+	if err != nil {
+		b.Fatal(err)
+	}
+	defer db.Close()
+	db.SetMaxOpenConns(1)
+	if _, err = db.Exec("create table foo (id integer primary key, data blob)"); err != nil {
+		b.Fatal(err)
+	}
+	latencies := make([]time.Duration, 0, b.N)
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		start := time.Now()
+		if _, err = db.Exec("insert into foo(data) values(randomblob(2000))"); err != nil {
+			b.Fatal(err)
+		}
+		latencies = append(latencies, time.Since(start))
+	}
+	b.StopTimer()
+	sort.Slice(latencies, func(i, j int) bool { return latencies[i] < latencies[j] })
+	b.ReportMetric(float64(latencies[len(latencies)*99/100].Nanoseconds()), "p99-ns")
+	b.ReportMetric(float64(latencies[len(latencies)-1].Nanoseconds()), "max-ns")
+}
+
+func BenchmarkWALCommitAutoCheckpoint(b *testing.B)       { benchmarkWALCommit(b, "") }
+func BenchmarkWALCommitBackgroundCheckpoint(b *testing.B) { benchmarkWALCommit(b, "&_bg_checkpoint=1000") }
+
+func BenchmarkCloseWithLiveConnections(b *testing.B) {
+	const live = 10000
+	d := SQLiteDriver{}
+	register := func(c *SQLiteConn) {
+		c.RegisterCommitHook(func() int { return 0 })
+		c.RegisterRollbackHook(func() {})
+		c.RegisterUpdateHook(func(int, string, string, int64) {})
+		if err := c.RegisterFunc("one", func() int64 { return 1 }, true); err != nil {
+			b.Fatal(err)
+		}
+	}
+	conns := make([]*SQLiteConn, 0, live)
+	defer func() {
+		for _, c := range conns {
+			c.Close()
+		}
+	}()
+	for i := 0; i < live; i++ {
+		conn, err := d.Open(":memory:")
+		if err != nil {
+			b.Fatal(err)
+		}
+		c := conn.(*SQLiteConn)
+		register(c)
+		conns = append(conns, c)
+	}
+
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		b.StopTimer()
+		conn, err := d.Open(":memory:")
+		if err != nil {
+			b.Fatal(err)
+		}
+		c := conn.(*SQLiteConn)
+		register(c)
+		b.StartTimer()
+		if err := c.Close(); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
+
+var customFunctionOnce sync.Once
+
+// registerCustomFunctions registers the sqlite3_BenchmarkCustomFunctions
+// driver, whose connections have the custom_add function, once per run.
+func registerCustomFunctions(b *testing.B) {
+	b.Helper()
+	customFunctionOnce.Do(func() {
+		customAdd := func(a, b int64) int64 {
+			return a + b
+		}
+
+		sql.Register("sqlite3_BenchmarkCustomFunctions", &SQLiteDriver{
+			ConnectHook: func(conn *SQLiteConn) error {
+				// Impure function to force sqlite to reexecute it each time.
+				return conn.RegisterFunc("custom_add", customAdd, false)
+			},
+		})
+	})
+}
+
+func BenchmarkCustomFunctions(b *testing.B) {
+	registerCustomFunctions(b)
+
+	db, err := sql.Open("sqlite3_BenchmarkCustomFunctions", ":memory:")
+	if err != nil {
+		b.Fatal("Failed to open database:", err)
+	}
+	defer db.Close()
+
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		var i int64
+		err = db.QueryRow("SELECT custom_add(1,2)").Scan(&i)
+		if err != nil {
+			b.Fatal("Failed to run custom add:", err)
+		}
+	}
+}
+
+func BenchmarkCustomFunctionsParallel(b *testing.B) {
+	registerCustomFunctions(b)
+
+	const conns = 32
+	db, err := sql.Open("sqlite3_BenchmarkCustomFunctions", ":memory:")
+	if err != nil {
+		b.Fatal("Failed to open database:", err)
+	}
+	defer db.Close()
+	db.SetMaxOpenConns(conns)
+	db.SetMaxIdleConns(conns)
+
+	procs := runtime.GOMAXPROCS(0)
+	b.SetParallelism((conns + procs - 1) / procs)
+	b.ResetTimer()
+	b.RunParallel(func(pb *testing.PB) {
+		for pb.Next() {
+			var n int64
+			err := db.QueryRow("WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT custom_add(i, 1) FROM n WHERE i < 1000) SELECT sum(custom_add(i, i)) FROM n").Scan(&n)
+			if err != nil {
+				b.Error("Failed to run custom add:", err)
+				return
+			}
+		}
+	})
 }
 
 func TestSuite(t *testing.T) {
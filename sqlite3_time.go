@@ -0,0 +1,237 @@
+// Copyright (C) 2019 Yasuhiro Matsumoto <mattn.jp@gmail.com>.
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file.
+
+//go:build cgo
+// +build cgo
+
+package sqlite3
+
+import (
+	"errors"
+	"fmt"
+	"math"
+	"strings"
+	"time"
+)
+
+// timeFormat selects how time.Time values are stored, see _time_format.
+type timeFormat uint8
+
+const (
+	timeFormatText      timeFormat = iota // SQLiteTimestampFormats[0]
+	timeFormatUnixNano                    // INTEGER nanoseconds since the Unix epoch
+	timeFormatUnixMilli                   // INTEGER milliseconds since the Unix epoch
+	timeFormatJulianDay                   // REAL Julian day number
+)
+
+// unixEpochJulianDay is the Julian day number of 1970-01-01 00:00:00 UTC.
+const unixEpochJulianDay = 2440587.5
+
+func parseTimeFormat(s string) (timeFormat, error) {
+	switch strings.ToLower(s) {
+	case "text":
+		return timeFormatText, nil
+	case "unixnano":
+		return timeFormatUnixNano, nil
+	case "unixmilli":
+		return timeFormatUnixMilli, nil
+	case "julianday":
+		return timeFormatJulianDay, nil
+	}
+	return 0, fmt.Errorf("Invalid _time_format: %v, expecting text, unixnano, unixmilli or julianday", s)
+}
+
+// Times _time_format=unixnano can store, from 1677-09-21 to 2262-04-11.
+var (
+	minUnixNano = time.Unix(0, math.MinInt64)
+	maxUnixNano = time.Unix(0, math.MaxInt64)
+)
+
+var errUnixNanoRange = errors.New("time out of the range of _time_format=unixnano, 1677-09-21 to 2262-04-11")
+
+// unixNano converts t to nanoseconds since the Unix epoch. Unlike
+// t.UnixNano, it fails rather than overflow outside the range of an int64.
+func unixNano(t time.Time) (int64, error) {
+	if t.Before(minUnixNano) || t.After(maxUnixNano) {
+		return 0, errUnixNanoRange
+	}
+	return t.UnixNano(), nil
+}
+
+// unixMilli converts t to milliseconds since the Unix epoch. It is not
+// derived from t.UnixNano, which overflows outside 1678-2262.
+func unixMilli(t time.Time) int64 {
+	return t.Unix()*1e3 + int64(t.Nanosecond()/1e6)
+}
+
+// julianDay converts t to a Julian day number.
+func julianDay(t time.Time) float64 {
+	return float64(t.Unix())/86400 + float64(t.Nanosecond())/86400e9 + unixEpochJulianDay
+}
+
+// fromJulianDay converts a Julian day number to a UTC time, rounded to the
+// millisecond since a float64 cannot hold more precision for current dates.
+func fromJulianDay(jd float64) time.Time {
+	ms := int64(math.Round((jd - unixEpochJulianDay) * 86400e3))
+	return time.Unix(ms/1e3, ms%1e3*1e6).UTC()
+}
+
+// Decoder kinds of a result column, resolved from its declared type.
+const (
+	decodeRaw uint8 = iota
+	decodeTime
+	decodeBool
+)
+
+// columnDecoder holds what is needed to convert the values of one result
+// column. It is built once per rows so that cells do not compare the
+// declared type again.
+type columnDecoder struct {
+	kind    uint8
+	storage timeFormat     // how numeric time values are to be read
+	format  int            // index of the SQLiteTimestampFormats entry that matched last
+	zone    *time.Location // fixed zone of the last parsed offset
+	zoneOff int
+}
+
+func newColumnDecoder(decltype string, storage timeFormat) columnDecoder {
+	switch decltype {
+	case columnTimestamp, columnDatetime, columnDate:
+		return columnDecoder{kind: decodeTime, storage: storage}
+	case "boolean":
+		return columnDecoder{kind: decodeBool}
+	default:
+		return columnDecoder{kind: decodeRaw}
+	}
+}
+
+// intTime converts an INTEGER time value to a UTC time.
+func (d *columnDecoder) intTime(val int64) time.Time {
+	switch d.storage {
+	case timeFormatUnixNano:
+		return time.Unix(0, val).UTC()
+	case timeFormatUnixMilli:
+		return time.Unix(val/1e3, val%1e3*1e6).UTC()
+	case timeFormatJulianDay:
+		// NUMERIC affinity stores whole Julian days as INTEGER.
+		return fromJulianDay(float64(val))
+	}
+	// Assume a millisecond unix timestamp if it's 13 digits -- too
+	// large to be a reasonable timestamp in seconds.
+	if val > 1e12 || val < -1e12 {
+		return time.Unix(0, val*int64(time.Millisecond)).UTC()
+	}
+	return time.Unix(val, 0).UTC()
+}
+
+// parseTime parses a TEXT timestamp as time.ParseInLocation would with
+// the first matching entry of SQLiteTimestampFormats and time.UTC.
+func (d *columnDecoder) parseTime(s string) (time.Time, error) {
+	s = strings.TrimSuffix(s, "Z")
+	if t, ok := d.parseTimeFast(s); ok {
+		return t, nil
+	}
+	var err error
+	for n := 0; n < len(SQLiteTimestampFormats); n++ {
+		f := (d.format + n) % len(SQLiteTimestampFormats)
+		var t time.Time
+		if t, err = time.ParseInLocation(SQLiteTimestampFormats[f], s, time.UTC); err == nil {
+			d.format = f
+			return t, nil
+		}
+	}
+	return time.Time{}, err
+}
+
+// parseTimeFast handles "2006-01-02 15:04:05.999999999-07:00", with a 'T'
+// in place of the space and with the fraction and offset optional. That
+// covers the layouts with seconds in SQLiteTimestampFormats. Anything else,
+// including fields out of range, is left to time.ParseInLocation.
+func (d *columnDecoder) parseTimeFast(s string) (time.Time, bool) {
+	if len(s) < 19 || s[4] != '-' || s[7] != '-' || (s[10] != ' ' && s[10] != 'T') || s[13] != ':' || s[16] != ':' {
+		return time.Time{}, false
+	}
+	year, ok1 := atoiFixed(s[0:4])
+	month, ok2 := atoiFixed(s[5:7])
+	day, ok3 := atoiFixed(s[8:10])
+	hour, ok4 := atoiFixed(s[11:13])
+	min, ok5 := atoiFixed(s[14:16])
+	sec, ok6 := atoiFixed(s[17:19])
+	if !(ok1 && ok2 && ok3 && ok4 && ok5 && ok6) ||
+		month < 1 || month > 12 || day < 1 || day > daysIn(month, year) ||
+		hour > 23 || min > 59 || sec > 59 {
+		return time.Time{}, false
+	}
+
+	rest := s[19:]
+	nsec := 0
+	if len(rest) > 0 && rest[0] == '.' {
+		i := 1
+		for i < len(rest) && rest[i] >= '0' && rest[i] <= '9' {
+			nsec = nsec*10 + int(rest[i]-'0')
+			i++
+		}
+		if i == 1 || i > 10 {
+			return time.Time{}, false
+		}
+		for n := i - 1; n < 9; n++ {
+			nsec *= 10
+		}
+		rest = rest[i:]
+	}
+
+	loc := time.UTC
+	if len(rest) > 0 {
+		if len(rest) != 6 || (rest[0] != '+' && rest[0] != '-') || rest[3] != ':' {
+			return time.Time{}, false
+		}
+		hh, ok1 := atoiFixed(rest[1:3])
+		mm, ok2 := atoiFixed(rest[4:6])
+		if !ok1 || !ok2 || hh > 23 || mm > 59 {
+			return time.Time{}, false
+		}
+		off := hh*3600 + mm*60
+		if rest[0] == '-' {
+			off = -off
+		}
+		loc = d.location(off)
+	}
+	return time.Date(year, time.Month(month), day, hour, min, sec, nsec, loc), true
+}
+
+// location returns the zone time.Parse uses for a numeric offset: UTC for
+// zero and an unnamed fixed zone otherwise, reused while the offset repeats.
+func (d *columnDecoder) location(off int) *time.Location {
+	if off == 0 {
+		return time.UTC
+	}
+	if d.zone == nil || d.zoneOff != off {
+		d.zone = time.FixedZone("", off)
+		d.zoneOff = off
+	}
+	return d.zone
+}
+
+// atoiFixed parses s, which must consist of decimal digits only.
+func atoiFixed(s string) (int, bool) {
+	n := 0
+	for i := 0; i < len(s); i++ {
+		c := s[i]
+		if c < '0' || c > '9' {
+			return 0, false
+		}
+		n = n*10 + int(c-'0')
+	}
+	return n, true
+}
+
+var monthDays = [13]int{0, 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31}
+
+func daysIn(month, year int) int {
+	if month == 2 && year%4 == 0 && (year%100 != 0 || year%400 == 0) {
+		return 29
+	}
+	return monthDays[month]
+}